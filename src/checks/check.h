@@ -0,0 +1,62 @@
+/* Minimal assertions and timing for the check executables, run by ctest */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <chrono>
+#include <cstdio>
+
+// failed CHECKs so far, main returns it so a failure fails the ctest run
+static int checkFailures = 0;
+
+// report a failed condition with a printf style message and carry on
+#define CHECK(condition, ...) \
+	do { \
+		if(!(condition)) \
+		{ \
+			std::printf("FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+			std::printf(__VA_ARGS__); \
+			std::printf("\n"); \
+			checkFailures++; \
+		} \
+	} while(0)
+
+/**
+ * Mean wall time of one call, best of a few rounds so a descheduled
+ * round does not count
+ * @param calls Calls per round
+ * @return Nanoseconds per call
+ */
+template <typename Function>
+double nanosPerCall(Function function, long long calls, int rounds = 5)
+{
+	double best = 0;
+	for(int round = 0; round < rounds; round++)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for(long long i = 0; i < calls; i++)
+			function(i);
+		double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / calls;
+		if(round == 0 || nanos < best)
+			best = nanos;
+	}
+	return best;
+}
+
+// keep a computed value alive so the optimizer cannot drop the work behind it
+template <typename T>
+inline void keep(const T& value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+inline int checkResult(const char* name)
+{
+	if(checkFailures)
+		std::printf("%s: %d checks failed\n", name, checkFailures);
+	else
+		std::printf("%s: all checks passed\n", name);
+	return checkFailures ? 1 : 0;
+}
+
+#endif /* CHECK_H_ */
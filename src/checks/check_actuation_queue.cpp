@@ -0,0 +1,97 @@
+// ActuationQueue: every due event applied in one step, equal times in insertion order
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "../event_queue.h"
+
+namespace {
+
+KinematicsWorld standingCars(int cars)
+{
+	KinematicsWorld world;
+	for(int i = 0; i < cars; i++)
+		world.add(0, 5*i, 0, 0, 2);
+	return world;
+}
+
+// a frame that several events of the same and of different cars fall into
+void checkOneFrame()
+{
+	KinematicsWorld world = standingCars(3);
+	ActuationQueue queue;
+	queue.push(100, 0, 1, 0.1f);
+	queue.push(200, 2, 5, 0.5f);
+	queue.push(40, 1, 3, 0.3f);
+	// same time as the first one, pushed later, so it is applied later and wins
+	queue.push(100, 0, 2, 0.2f);
+	queue.push(70, 0, 4, 0.4f);
+
+	int applied = queue.applyDue(10, world);
+	CHECK(applied == 0 && queue.size() == 5, "nothing due at 10 us, applied %d, %zu left", applied, queue.size());
+
+	// an event exactly at the frame's time is due
+	applied = queue.applyDue(100, world);
+	CHECK(applied == 4, "%d of the 4 events due at 100 us applied", applied);
+	CHECK(world.acceleration[0] == 2 && world.steering[0] == 0.2f, "car 0 left at the event pushed %s",
+		world.acceleration[0] == 1 ? "first of the two at 100 us" : "before them");
+	CHECK(world.acceleration[1] == 3 && world.steering[1] == 0.3f, "car 1 at acceleration %g", world.acceleration[1]);
+	CHECK(world.acceleration[2] == 0 && world.steering[2] == 0, "car 2 got its event at 200 us early");
+	CHECK(queue.size() == 1 && queue.nextTime() == 200, "%zu events left, next at %lld us", queue.size(), queue.empty() ? -1 : queue.nextTime());
+
+	applied = queue.applyDue(1000, world);
+	CHECK(applied == 1 && queue.empty() && world.acceleration[2] == 5, "last event: applied %d, car 2 at %g", applied, world.acceleration[2]);
+}
+
+/**
+ * Many events on few distinct times, pushed in random order and applied in
+ * frames of random length: after every frame each car has to hold the
+ * latest due event by time, the last pushed one among equal times
+ */
+void checkRandomFrames()
+{
+	const int cars = 16, events = 20000;
+	std::mt19937 generator(3);
+	std::uniform_int_distribution<int> car(0, cars - 1), tick(0, 4000), frameLength(0, 30);
+	KinematicsWorld world = standingCars(cars);
+	ActuationQueue queue;
+	std::vector<ActuationEvent> pushed;
+	for(int e = 0; e < events; e++)
+	{
+		// acceleration carries the event's number so the winner can be told apart
+		ActuationEvent event = {10LL * tick(generator), car(generator), (float)e, (float)(e % 7), e};
+		pushed.push_back(event);
+		queue.push(event.time_us, event.car, event.acceleration, event.steering);
+	}
+
+	std::vector<float> expected(cars, 0);
+	std::stable_sort(pushed.begin(), pushed.end(), [](const ActuationEvent& a, const ActuationEvent& b) { return a.time_us < b.time_us; });
+	size_t next = 0;
+	int wrong = 0, frames = 0;
+	long long appliedTotal = 0;
+	for(long long now = 0; !queue.empty(); now += 10 * frameLength(generator), frames++)
+	{
+		int due = 0;
+		for(; next < pushed.size() && pushed[next].time_us <= now; next++, due++)
+			expected[pushed[next].car] = pushed[next].acceleration;
+		int applied = queue.applyDue(now, world);
+		appliedTotal += applied;
+		wrong += applied != due;
+		for(int c = 0; c < cars; c++)
+			wrong += world.acceleration[c] != expected[c] || world.steering[c] != (float)((int)expected[c] % 7);
+	}
+	std::printf("ActuationQueue: %d events over %d frames, %lld applied, %d mismatches\n", events, frames, appliedTotal, wrong);
+	CHECK(appliedTotal == events, "%lld of %d events applied", appliedTotal, events);
+	CHECK(wrong == 0, "%d frames or cars differ from the events in time and insertion order", wrong);
+}
+
+}
+
+int main()
+{
+	checkOneFrame();
+	checkRandomFrames();
+	return checkResult("check_actuation_queue");
+}
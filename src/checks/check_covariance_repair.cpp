@@ -0,0 +1,97 @@
+// Covariance repair: a filter whose P_ lost positive definiteness counts it, repairs it and keeps tracking
+
+#include <cmath>
+#include <cstdio>
+#include "check.h"
+#include "../ukf.h"
+
+namespace {
+
+// a target driving a gentle curve, noise free
+struct Target
+{
+	double x(long long t) const { return 10 + 8*std::cos(0.2 + 0.05*t/1e6)*t/1e6; }
+	double y(long long t) const { return -4 + 8*std::sin(0.2 + 0.05*t/1e6)*t/1e6; }
+};
+
+MeasurementPackage lidarAt(const Target& target, long long t)
+{
+	MeasurementPackage package;
+	package.sensor_type_ = MeasurementPackage::LASER;
+	package.timestamp_ = t;
+	package.raw_measurements_ = Eigen::VectorXd(2);
+	package.raw_measurements_ << target.x(t), target.y(t);
+	return package;
+}
+
+const long long kStep_us = 50000;
+
+template <typename Filter>
+bool positiveDefinite(const Filter& ukf)
+{
+	if((ukf.P_ - ukf.P_.transpose()).cwiseAbs().maxCoeff() > 1e-5 * ukf.P_.cwiseAbs().maxCoeff())
+		return false;
+	Eigen::LLT<typename Filter::MatrixX> llt(ukf.P_);
+	return llt.info() == Eigen::Success && llt.matrixL().toDenseMatrix().diagonal().minCoeff() > 0;
+}
+
+/**
+ * Track the target, break P_ in the middle of the run and keep tracking.
+ * Two breaks: a correlation above 1 between px and py, which keeps the
+ * diagonal positive so only the Cholesky factorization notices, and a
+ * negative variance of the speed.
+ */
+template <typename Scalar>
+void checkRepair(typename UKFT<Scalar>::CovarianceUpdate update, const char* name)
+{
+	Target target;
+	for(int negativeDiagonal = 0; negativeDiagonal < 2; negativeDiagonal++)
+	{
+		UKFT<Scalar> ukf;
+		ukf.cov_update_ = update;
+		long long t = 0;
+		for(int k = 0; k < 40; k++, t += kStep_us)
+			ukf.ProcessMeasurement(lidarAt(target, t));
+
+		if(negativeDiagonal)
+			ukf.P_(2, 2) = -1;
+		else
+			ukf.P_(0, 1) = ukf.P_(1, 0) = 3 * std::sqrt(ukf.P_(0, 0) * ukf.P_(1, 1));
+		long llt_failures = ukf.health_.llt_failures, repairs = ukf.health_.repairs;
+		ukf.ProcessMeasurement(lidarAt(target, t));
+		t += kStep_us;
+		long failed = ukf.health_.llt_failures - llt_failures, repaired = ukf.health_.repairs - repairs;
+		bool repairedDefinite = positiveDefinite(ukf);
+		bool finite = ukf.x_.allFinite() && ukf.P_.allFinite();
+
+		for(int k = 0; k < 40; k++, t += kStep_us)
+			ukf.ProcessMeasurement(lidarAt(target, t));
+		t -= kStep_us;
+		double error = std::hypot(ukf.x_(0) - target.x(t), ukf.x_(1) - target.y(t));
+		std::printf("%-6s %-10s %-22s llt failures %ld, repairs %ld, %.3f m off 2 s later\n",
+			sizeof(Scalar) == sizeof(float) ? "float" : "double", name, negativeDiagonal ? "negative variance" : "correlation above 1",
+			failed, repaired, error);
+		CHECK(failed == 1 && repaired >= 1, "%s %s: %ld llt failures and %ld repairs after breaking P_", name,
+			negativeDiagonal ? "negative variance" : "correlation above 1", failed, repaired);
+		CHECK(repairedDefinite && finite, "%s: P_ is not positive definite after the repairing update", name);
+		CHECK(positiveDefinite(ukf), "%s: P_ is not positive definite 40 updates after the repair", name);
+		CHECK(error < 0.1, "%s: track %g m off the target 40 updates after the repair", name, error);
+	}
+}
+
+template <typename Scalar>
+void checkAll()
+{
+	checkRepair<Scalar>(UKFT<Scalar>::STANDARD, "STANDARD");
+	checkRepair<Scalar>(UKFT<Scalar>::JOSEPH, "JOSEPH");
+	checkRepair<Scalar>(UKFT<Scalar>::SYMMETRIZE, "SYMMETRIZE");
+}
+
+}
+
+int main()
+{
+	checkAll<double>();
+	checkAll<float>();
+	return checkResult("check_covariance_repair");
+}
@@ -0,0 +1,187 @@
+// Frame transforms, ego dead reckoning, sensor frames and the start of tracks seen from a moving sensor
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "check.h"
+#include "../frames.h"
+#include "../models.h"
+
+namespace {
+
+double gap(const FrameTransform& a, const FrameTransform& b)
+{
+	double worst = std::max(std::fabs(a.x - b.x), std::fabs(a.y - b.y));
+	worst = std::max(worst, std::fabs(a.cosYaw - b.cosYaw));
+	return std::max(worst, std::fabs(a.sinYaw - b.sinYaw));
+}
+
+// composing is applying one after the other, and a transform and its inverse cancel
+void checkTransforms()
+{
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<double> coordinate(-500, 500), angle(-M_PI, M_PI);
+	double worstCompose = 0, worstInverse = 0, worstTrig = 0, worstBatch = 0;
+	FrameTransform chain;
+	for(int k = 0; k < 10000; k++)
+	{
+		FrameTransform a(coordinate(generator), coordinate(generator), angle(generator));
+		FrameTransform b(coordinate(generator), coordinate(generator), angle(generator));
+		double px = coordinate(generator), py = coordinate(generator);
+
+		double sx = px, sy = py;
+		b.apply(sx, sy);
+		a.apply(sx, sy);
+		double cx = px, cy = py;
+		(a * b).apply(cx, cy);
+		worstCompose = std::max(worstCompose, std::max(std::fabs(cx - sx), std::fabs(cy - sy)));
+
+		worstInverse = std::max(worstInverse, gap(a * a.inverse(), FrameTransform()));
+		worstInverse = std::max(worstInverse, gap(a.inverse() * a, FrameTransform()));
+		double rx = px, ry = py;
+		a.apply(rx, ry);
+		a.inverse().apply(rx, ry);
+		worstInverse = std::max(worstInverse, std::max(std::fabs(rx - px), std::fabs(ry - py)));
+
+		double bx[2] = {px, -py}, by[2] = {py, px};
+		a.apply(2, bx, by);
+		double ex = px, ey = py;
+		a.apply(ex, ey);
+		worstBatch = std::max(worstBatch, std::max(std::fabs(bx[0] - ex), std::fabs(by[0] - ey)));
+
+		// a long chain keeps its cosine and sine on its angle without any trig
+		chain = chain * FrameTransform(0, 0, angle(generator));
+		worstTrig = std::max(worstTrig, std::max(std::fabs(chain.cosYaw - std::cos(chain.yaw)), std::fabs(chain.sinYaw - std::sin(chain.yaw))));
+	}
+	std::printf("FrameTransform: compose %.2g m, inverse %.2g, batch %.2g m, cos/sin drift over 10000 compositions %.2g\n",
+		worstCompose, worstInverse, worstBatch, worstTrig);
+	CHECK(worstCompose < 1e-9, "(a*b).apply is %g m from a.apply(b.apply)", worstCompose);
+	CHECK(worstInverse < 1e-9, "a transform and its inverse leave %g", worstInverse);
+	CHECK(worstBatch == 0, "batch apply differs from apply by %g m", worstBatch);
+	CHECK(worstTrig < 1e-9, "composed cosine and sine drift %g from the angle", worstTrig);
+}
+
+// dead reckoning against the closed form straight line and circle
+void checkEgoMotion()
+{
+	const double speed = 20, yawRate = 0.25;
+	const long long step_us = 33333;
+	EgoMotion straight, turning;
+	double worstStraight = 0, worstCircle = 0;
+	for(int k = 0; k <= 800; k++)
+	{
+		long long timestamp = k * step_us;
+		straight.update(EgoOdometry{timestamp, speed, 0});
+		turning.update(EgoOdometry{timestamp, speed, yawRate});
+		double t = timestamp / 1.0e6;
+		const FrameTransform& line = straight.egoToWorld();
+		worstStraight = std::max(worstStraight, std::max(std::fabs(line.x - speed*t), std::fabs(line.y)));
+		const FrameTransform& arc = turning.egoToWorld();
+		double radius = speed / yawRate;
+		worstCircle = std::max(worstCircle, std::max(std::fabs(arc.x - radius*std::sin(yawRate*t)), std::fabs(arc.y - radius*(1 - std::cos(yawRate*t)))));
+		worstCircle = std::max(worstCircle, std::fabs(turning.velocityX() - speed*std::cos(yawRate*t)) + std::fabs(turning.velocityY() - speed*std::sin(yawRate*t)));
+	}
+	std::printf("EgoMotion: straight line %.2g m, circle of %.0f m %.2g m off after 800 steps\n", worstStraight, speed/yawRate, worstCircle);
+	CHECK(worstStraight < 1e-9, "straight driving is %g m off", worstStraight);
+	CHECK(worstCircle < 1e-6, "driving a circle is %g off", worstCircle);
+}
+
+/**
+ * A sensor mounted off the ego's origin and turned: its world transform is
+ * ego times mount, its velocity the rate of change of its position, and a
+ * measurement moved into the world frame measures the same as in the
+ * sensor's frame
+ */
+void checkFrameSet()
+{
+	const FrameTransform mount(3.2, -0.8, 0.4);
+	FrameSet frames;
+	frames.addSensor(FrameTransform());
+	int sensor = frames.addSensor(mount);
+	EgoMotion ego;
+	const double speed = 15, yawRate = -0.3;
+	ego.update(EgoOdometry{0, speed, yawRate});
+	ego.update(EgoOdometry{1700000, speed, yawRate});
+	frames.update(ego);
+	const FrameTransform toWorld = frames.sensorToWorld(sensor);
+	double worstMount = gap(toWorld, ego.egoToWorld() * mount);
+
+	// the sensor's velocity against its positions 1 ms before and after
+	EgoMotion earlier, later;
+	earlier.update(EgoOdometry{0, speed, yawRate});
+	earlier.update(EgoOdometry{1699000, speed, yawRate});
+	later.update(EgoOdometry{0, speed, yawRate});
+	later.update(EgoOdometry{1701000, speed, yawRate});
+	FrameTransform before = earlier.egoToWorld() * mount, after = later.egoToWorld() * mount;
+	double sensorVx = (after.x - before.x) / 2e-3, sensorVy = (after.y - before.y) / 2e-3;
+	MeasurementPackage probe;
+	probe.sensor_type_ = MeasurementPackage::LASER;
+	probe.raw_measurements_ = Eigen::VectorXd::Zero(2);
+	frames.toWorldFrame(sensor, probe);
+	double worstVelocity = std::fabs(probe.sensor_vx_ - sensorVx) + std::fabs(probe.sensor_vy_ - sensorVy);
+
+	// a target in the world frame, seen by the sensor in its own frame
+	const double targetX = toWorld.x + 30, targetY = toWorld.y - 12, targetV = 22, targetYaw = 0.2;
+	double sx = targetX, sy = targetY;
+	toWorld.inverse().apply(sx, sy);
+	MeasurementPackage laser;
+	laser.sensor_type_ = MeasurementPackage::LASER;
+	laser.raw_measurements_ = Eigen::VectorXd(2);
+	laser.raw_measurements_ << sx, sy;
+	frames.toWorldFrame(sensor, laser);
+	double worstLaser = std::fabs(laser.raw_measurements_(0) - targetX) + std::fabs(laser.raw_measurements_(1) - targetY);
+
+	// relative to the sensor's velocity checked above, so only the frames are compared
+	double rvx = targetV*std::cos(targetYaw) - probe.sensor_vx_, rvy = targetV*std::sin(targetYaw) - probe.sensor_vy_;
+	toWorld.inverse().rotate(rvx, rvy);
+	double rho = std::sqrt(sx*sx + sy*sy);
+	MeasurementPackage radar;
+	radar.sensor_type_ = MeasurementPackage::RADAR;
+	radar.raw_measurements_ = Eigen::VectorXd(3);
+	radar.raw_measurements_ << rho, std::atan2(sy, sx), (sx*rvx + sy*rvy) / rho;
+	frames.toWorldFrame(sensor, radar);
+	RadarModel model(0.3, 0.03, 0.3, radar.sensor_x_, radar.sensor_y_, radar.sensor_vx_, radar.sensor_vy_);
+	Eigen::VectorXd state(5), measured(3);
+	state << targetX, targetY, targetV, targetYaw, 0;
+	model.Measure(state, measured.head(3));
+	Eigen::VectorXd residual = measured - radar.raw_measurements_;
+	model.Normalize(residual);
+	double worstRadar = residual.cwiseAbs().maxCoeff();
+
+	std::printf("FrameSet: mount %.2g, sensor velocity %.2g m/s, laser %.2g m, radar residual %.2g\n",
+		worstMount, worstVelocity, worstLaser, worstRadar);
+	CHECK(worstMount < 1e-12, "sensorToWorld is %g from ego * mount", worstMount);
+	CHECK(worstVelocity < 1e-6, "sensor velocity is %g m/s off its rate of change", worstVelocity);
+	CHECK(worstLaser < 1e-9, "laser point in the world frame is %g m off", worstLaser);
+	CHECK(worstRadar < 1e-9, "RadarModel with the sensor's pose is %g off the sensor's measurement", worstRadar);
+}
+
+// a new track seen from a moving sensor starts at the sensor's velocity, one from a standing sensor at the filter's prior
+void checkCarrierPrior()
+{
+	Eigen::VectorXd z(2), x = Eigen::VectorXd::Zero(5);
+	z << 12, -3;
+	Eigen::MatrixXd P = Eigen::MatrixXd::Identity(5, 5);
+	LidarModel(0.15, 0.15).Initialize(z, x, P);
+	CHECK(x(0) == 12 && x(1) == -3 && x(2) == 0 && x(3) == 0, "standing lidar starts a track at v %g yaw %g", x(2), x(3));
+	CHECK(P == Eigen::MatrixXd::Identity(5, 5), "standing lidar changed the prior covariance");
+
+	Eigen::VectorXd polar(3);
+	polar << 10, 0.5, 0;
+	RadarModel(0.3, 0.03, 0.3, 100, 50, 0, -25).Initialize(polar, x, P);
+	CHECK(std::fabs(x(0) - (100 + 10*std::cos(0.5))) < 1e-12 && std::fabs(x(1) - (50 + 10*std::sin(0.5))) < 1e-12,
+		"radar on a moving car starts a track at (%g, %g)", x(0), x(1));
+	CHECK(std::fabs(x(2) - 25) < 1e-12 && std::fabs(x(3) + M_PI/2) < 1e-12, "radar driving at 25 m/s south starts a track at v %g yaw %g", x(2), x(3));
+	CHECK(P(2,2) < 25 && P(3,3) < 0.09 && P(0,0) == 1, "track from a moving radar starts with variances v %g yaw %g px %g", P(2,2), P(3,3), P(0,0));
+}
+
+}
+
+int main()
+{
+	checkTransforms();
+	checkEgoMotion();
+	checkFrameSet();
+	checkCarrierPrior();
+	return checkResult("check_frames");
+}
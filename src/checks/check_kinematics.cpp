@@ -0,0 +1,106 @@
+// KinematicsWorld: step against the scalar bicycle model of Car::move, and its cost per thousand cars
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "../kinematics.h"
+#include "../render/render.h"
+
+namespace {
+
+/**
+ * The same cars and actuations stepped by KinematicsWorld::step and by
+ * Car::move for 10 s at 30 Hz, with accelerations and steering changing
+ * every second. step rotates the heading's cosine and sine instead of
+ * calling libm, so the two drift apart only by float rounding.
+ */
+void checkAgainstCar()
+{
+	const int cars = 200, steps = 300;
+	const float dt = 1.0f / 30;
+	std::mt19937 generator(5);
+	std::uniform_real_distribution<float> position(-100, 100), speed(0, 30), heading(-3.1f, 3.1f), acceleration(-2, 2), steering(-0.1f, 0.1f);
+	KinematicsWorld world;
+	std::vector<Car> traffic;
+	for(int i = 0; i < cars; i++)
+	{
+		float x = position(generator), y = position(generator), v = speed(generator), angle = heading(generator);
+		world.add(x, y, v, angle, 2);
+		traffic.push_back(Car(Vect3(x, y, 0), Vect3(4, 2, 2), Color(0, 0, 1), v, angle, 2, "car"+std::to_string(i)));
+	}
+
+	double worstPosition = 0, worstVelocity = 0, worstAngle = 0, worstTrig = 0, farthest = 0;
+	for(int k = 0; k < steps; k++)
+	{
+		if(k % 30 == 0)
+		{
+			for(int i = 0; i < cars; i++)
+			{
+				float a = acceleration(generator), s = steering(generator);
+				world.setActuation(i, a, s);
+				traffic[i].setAcceleration(a);
+				traffic[i].setSteering(s);
+			}
+		}
+		world.step(dt);
+		for(int i = 0; i < cars; i++)
+			traffic[i].move(dt, (int)(k * dt * 1e6));
+	}
+	for(int i = 0; i < cars; i++)
+	{
+		const Car& car = traffic[i];
+		worstPosition = std::max(worstPosition, std::hypot(world.x[i] - car.position.x, world.y[i] - car.position.y));
+		worstVelocity = std::max(worstVelocity, (double)std::fabs(world.velocity[i] - car.velocity));
+		worstAngle = std::max(worstAngle, (double)std::fabs(world.angle[i] - car.angle));
+		worstTrig = std::max(worstTrig, std::fabs(world.cosAngle[i] - std::cos((double)world.angle[i])) + std::fabs(world.sinAngle[i] - std::sin((double)world.angle[i])));
+		farthest = std::max(farthest, std::hypot(world.x[i], world.y[i]));
+	}
+	std::printf("KinematicsWorld vs Car::move, %d cars over %d steps up to %.0f m out: position %.2g m, velocity %.2g m/s, angle %.2g rad, cos/sin %.2g\n",
+		cars, steps, farthest, worstPosition, worstVelocity, worstAngle, worstTrig);
+	CHECK(worstPosition < 1e-2, "step is %g m off Car::move after %d steps", worstPosition, steps);
+	CHECK(worstVelocity < 1e-4, "step velocity is %g m/s off Car::move", worstVelocity);
+	CHECK(worstAngle < 1e-4, "step heading is %g rad off Car::move", worstAngle);
+	CHECK(worstTrig < 1e-4, "rotated cosine and sine are %g off the heading", worstTrig);
+}
+
+// microseconds per thousand cars for one step of either model
+void benchmark()
+{
+	const int cars = 10000;
+	const float dt = 1.0f / 30;
+	KinematicsWorld world;
+	std::vector<Car> traffic;
+	for(int i = 0; i < cars; i++)
+	{
+		float angle = 0.001f * i;
+		world.add(0, 4*i, 20, angle, 2);
+		world.setActuation(i, 0.1f, 0.01f);
+		traffic.push_back(Car(Vect3(0, 4*i, 0), Vect3(4, 2, 2), Color(0, 0, 1), 20, angle, 2, "car"));
+		traffic.back().setAcceleration(0.1f);
+		traffic.back().setSteering(0.01f);
+	}
+	const double perThousand = 1e-3 * 1000.0 / cars;
+	double step = nanosPerCall([&](long long) { world.step(dt); keep(world.x[0]); }, 200) * perThousand;
+	double move = nanosPerCall([&](long long k)
+	{
+		for(Car& car : traffic)
+			car.move(dt, (int)k);
+		keep(traffic[0].position);
+	}, 200) * perThousand;
+	std::printf("%-28s %8s\n", "us per 1000 cars and step", "");
+	std::printf("%-28s %8.2f\n", "KinematicsWorld::step", step);
+	std::printf("%-28s %8.2f\n", "Car::move", move);
+	CHECK(step < move, "KinematicsWorld::step takes %.2f us per 1000 cars, Car::move %.2f", step, move);
+}
+
+}
+
+int main()
+{
+	checkAgainstCar();
+	benchmark();
+	return checkResult("check_kinematics");
+}
@@ -0,0 +1,206 @@
+// Lidar scan variants return the same points as Lidar::scan, and sweeps keep time order
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "check.h"
+#include "../scenario.h"
+#include "../sensors/lidar.h"
+
+namespace {
+
+// the traffic of the three car highway scene
+std::vector<Car> highwayCars()
+{
+	Scenario scenario = Scenario::highway();
+	std::vector<Car> cars;
+	for(size_t i = 0; i < scenario.cars.size(); i++)
+	{
+		const ScenarioCar& sc = scenario.cars[i];
+		cars.push_back(Car(Vect3(sc.x, sc.y, 0), Vect3(4, 2, 2), Color(0, 0, 1), sc.velocity, sc.angle, 2, "car"+std::to_string(i+1)));
+	}
+	return cars;
+}
+
+// the highway scene seen by a lidar with the default elevations and a coarser sweep, so a full scan takes well under a second
+Lidar highwayLidar()
+{
+	Lidar lidar(highwayCars(), 0);
+	lidar.beams = LidarBeams::spinning(64, 24.8*(-pi/180), 26.8*(pi/180), 900, 2*pi);
+	return lidar;
+}
+
+double distance(const pcl::PointXYZ& a, const pcl::PointXYZ& b)
+{
+	return std::sqrt((a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y) + (a.z-b.z)*(a.z-b.z));
+}
+
+/**
+ * Compare two clouds point by point, in order
+ * @return largest distance between corresponding points, -1 if the counts differ
+ */
+double cloudDistance(const std::vector<pcl::PointXYZ>& expected, const std::vector<pcl::PointXYZ>& actual)
+{
+	if(expected.size() != actual.size())
+		return -1;
+	double worst = 0;
+	for(size_t i = 0; i < expected.size(); i++)
+		worst = std::max(worst, distance(expected[i], actual[i]));
+	return worst;
+}
+
+// points of scan() for a fixed noise seed
+std::vector<pcl::PointXYZ> reference(Lidar& lidar, unsigned int seed)
+{
+	std::srand(seed);
+	return lidar.scan()->points;
+}
+
+void checkOrganized()
+{
+	Lidar lidar = highwayLidar();
+	lidar.sderr = 0;
+	std::vector<pcl::PointXYZ> expected = reference(lidar, 1);
+
+	RangeImage image;
+	std::srand(1);
+	lidar.scanOrganized(image);
+	// the organized cloud keeps a NaN point per ray without a return, in the same layer-major order as scan()
+	pcl::PointCloud<pcl::PointXYZ>::Ptr organized = image.toCloud();
+	std::vector<pcl::PointXYZ> actual;
+	for(const pcl::PointXYZ& point : organized->points)
+		if(!std::isnan(point.x))
+			actual.push_back(point);
+
+	// ranges are stored in kRangeUnit steps and turned back into XYZ in float
+	double worst = cloudDistance(expected, actual);
+	std::printf("scanOrganized: %zu points, scan(): %zu points, largest distance %.2g m\n", actual.size(), expected.size(), worst);
+	CHECK(worst >= 0, "scanOrganized returns %zu points, scan() %zu", actual.size(), expected.size());
+	CHECK(worst <= kRangeUnit, "scanOrganized points are up to %g m from those of scan()", worst);
+}
+
+
+void checkIncremental()
+{
+	Lidar lidar = highwayLidar();
+	std::vector<Car> cars = highwayCars();
+	const int rays = lidar.beams->layers() * lidar.beams->columns();
+
+	// noise is drawn in the same order, so with the same seed the points match up to rounding of the step sums
+	std::srand(2);
+	std::vector<pcl::PointXYZ> first = lidar.scanIncremental()->points;
+	double worst = cloudDistance(reference(lidar, 2), first);
+	CHECK(worst >= 0 && worst <= 1e-4, "first scanIncremental is %g m from scan()", worst);
+	CHECK(lidar.raysCast == rays, "first scanIncremental casts %d of %d rays", lidar.raysCast, rays);
+
+	for(int frame = 1; frame <= 10; frame++)
+	{
+		for(Car& car : cars)
+			car.move(0.1, frame * 100000);
+		lidar.updateCars(cars);
+		std::srand(frame);
+		std::vector<pcl::PointXYZ> incremental = lidar.scanIncremental()->points;
+		worst = cloudDistance(reference(lidar, frame), incremental);
+		CHECK(worst >= 0 && worst <= 1e-4, "frame %d: scanIncremental returns %zu points up to %g m from scan()", frame, incremental.size(), worst);
+		CHECK(lidar.raysCast < rays, "frame %d: scanIncremental casts all %d rays", frame, rays);
+	}
+	std::printf("scanIncremental after cars moved: %d of %d rays cast, largest distance to scan() %.2g m\n", lidar.raysCast, rays, worst);
+
+	// a car added to the scene recasts everything
+	cars.push_back(Car(Vect3(10, -4, 0), Vect3(4, 2, 2), Color(0, 0, 1), 5, 0, 2, "added"));
+	lidar.updateCars(cars);
+	std::srand(11);
+	std::vector<pcl::PointXYZ> added = lidar.scanIncremental()->points;
+	worst = cloudDistance(reference(lidar, 11), added);
+	CHECK(worst >= 0 && worst <= 1e-4, "after adding a car scanIncremental is %g m from scan()", worst);
+	CHECK(lidar.raysCast == rays, "after adding a car scanIncremental casts %d of %d rays", lidar.raysCast, rays);
+
+	double full = nanosPerCall([&](long long) { keep(lidar.scan()->points.size()); }, 5, 3) / 1e6;
+	double incremental = nanosPerCall([&](long long i)
+	{
+		for(Car& car : cars)
+			car.move(0.1, (int)(1100000 + i * 100000));
+		lidar.updateCars(cars);
+		keep(lidar.scanIncremental()->points.size());
+	}, 5, 3) / 1e6;
+	std::printf("scan %.2f ms, scanIncremental %.2f ms per moving frame\n", full, incremental);
+}
+
+
+// points in x, y, z order, for comparing clouds that list their points in different orders
+std::vector<pcl::PointXYZ> sorted(std::vector<pcl::PointXYZ> points)
+{
+	std::sort(points.begin(), points.end(), [](const pcl::PointXYZ& a, const pcl::PointXYZ& b)
+	{
+		return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+	});
+	return points;
+}
+
+// with the cars standing still and no noise a sweep is scan() in column order
+void checkSweepStatic()
+{
+	Lidar lidar = highwayLidar();
+	lidar.sderr = 0;
+	lidar.sweepThreads = 3;
+	std::vector<Car> cars = highwayCars();
+	std::vector<pcl::PointXYZ> expected = sorted(reference(lidar, 1));
+
+	LidarSweep first, second;
+	lidar.scanSweep(cars, cars, 0, 0.1, first);
+	// the second sweep runs on the workers the first one started
+	std::shared_ptr<WorkerPool> workers = lidar.sweepWorkers;
+	lidar.scanSweep(cars, cars, 0, 0.1, second);
+	std::vector<pcl::PointXYZ> actual;
+	for(const SweepPoint& point : first.points)
+		actual.push_back(pcl::PointXYZ(point.x, point.y, point.z));
+	double worst = cloudDistance(expected, sorted(actual));
+	bool repeated = first.points.size() == second.points.size();
+	for(size_t i = 0; repeated && i < first.points.size(); i++)
+		repeated = first.points[i].x == second.points[i].x && first.points[i].y == second.points[i].y && first.points[i].z == second.points[i].z;
+
+	std::printf("scanSweep of standing cars: %zu points, scan(): %zu points, largest distance %.2g m\n", actual.size(), expected.size(), worst);
+	CHECK(worst >= 0, "scanSweep returns %zu points, scan() %zu", actual.size(), expected.size());
+	// the culled cast walks the same steps in double, the sweep stores them in float
+	CHECK(worst <= 1e-5, "scanSweep points are up to %g m from those of scan()", worst);
+	CHECK(repeated, "two sweeps of the same scene differ");
+	CHECK(workers && workers == lidar.sweepWorkers && workers->threads() == 3, "scanSweep did not keep its %d worker threads", lidar.sweepThreads);
+}
+
+// a car driving through the sweep: returns come out in firing order, all within the period
+void checkSweepTime()
+{
+	Lidar lidar = highwayLidar();
+	std::vector<Car> start = highwayCars(), end = start;
+	const double period_s = 0.1;
+	for(Car& car : end)
+		car.move(period_s, (int)(period_s * 1e6));
+	LidarSweep sweep;
+	lidar.scanSweep(start, end, 5000000, period_s, sweep);
+
+	int backwards = 0;
+	uint32_t last = 0;
+	for(const SweepPoint& point : sweep.points)
+	{
+		backwards += point.offset_us < last;
+		last = point.offset_us;
+	}
+	std::printf("scanSweep of moving cars: %zu points over %u us\n", sweep.points.size(), last);
+	CHECK(sweep.timestamp_us == 5000000, "sweep stamped %lld", sweep.timestamp_us);
+	CHECK(!sweep.points.empty(), "sweep of moving cars has no points");
+	CHECK(backwards == 0, "%d returns earlier than the one before them", backwards);
+	CHECK(last < period_s * 1e6, "return at %u us after a sweep of %g s", last, period_s);
+}
+
+}
+
+int main()
+{
+	checkOrganized();
+	checkIncremental();
+	checkSweepStatic();
+	checkSweepTime();
+	return checkResult("check_lidar");
+}
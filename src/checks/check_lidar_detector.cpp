@@ -0,0 +1,130 @@
+// LidarDetector: one detection per car of the highway scene, none on the road, sweep times within the sweep
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "check.h"
+#include "../scenario.h"
+#include "../sensors/lidar_detector.h"
+
+namespace {
+
+std::vector<Car> highwayCars()
+{
+	Scenario scenario = Scenario::highway();
+	std::vector<Car> cars;
+	for(size_t i = 0; i < scenario.cars.size(); i++)
+	{
+		const ScenarioCar& sc = scenario.cars[i];
+		cars.push_back(Car(Vect3(sc.x, sc.y, 0), Vect3(4, 2, 2), Color(0, 0, 1), sc.velocity, sc.angle, 2, "car"+std::to_string(i+1)));
+	}
+	return cars;
+}
+
+/**
+ * Match every detection to the nearest car position
+ * @return largest distance of a detection to its car, -1 unless every car
+ * has exactly one detection within tolerance and every detection a car
+ */
+double matchCars(const std::vector<MeasurementPackage>& detections, const std::vector<double>& carX, const std::vector<double>& carY, double tolerance)
+{
+	double worst = 0;
+	std::vector<int> hits(carX.size(), 0);
+	for(const MeasurementPackage& detection : detections)
+	{
+		int nearest = -1;
+		double nearestDistance = tolerance;
+		for(size_t c = 0; c < carX.size(); c++)
+		{
+			double distance = std::hypot(detection.raw_measurements_(0) - carX[c], detection.raw_measurements_(1) - carY[c]);
+			if(distance <= nearestDistance)
+			{
+				nearest = (int)c;
+				nearestDistance = distance;
+			}
+		}
+		if(nearest < 0)
+			return -1;
+		hits[nearest]++;
+		worst = std::max(worst, nearestDistance);
+	}
+	for(int h : hits)
+		if(h != 1)
+			return -1;
+	return worst;
+}
+
+// a full scan of the standing scene
+void checkScan()
+{
+	std::vector<Car> cars = highwayCars();
+	Lidar lidar(cars, 0);
+	LidarDetector detector;
+	std::vector<MeasurementPackage> detections = detector.detect(*lidar.scan(), 1000);
+	std::vector<double> carX, carY;
+	for(const Car& car : cars)
+	{
+		carX.push_back(car.position.x);
+		carY.push_back(car.position.y);
+	}
+	double worst = matchCars(detections, carX, carY, 0.5);
+	std::printf("detect(scan()): %zu detections of %zu cars, farthest %.3f m from its car\n", detections.size(), cars.size(), worst);
+	CHECK(worst >= 0, "%zu detections do not pair up with the %zu cars within 0.5 m", detections.size(), cars.size());
+	for(const LidarCluster& cluster : detector.clusters())
+		CHECK(cluster.z > detector.config.groundTolerance, "cluster at (%g, %g) is %g m high", cluster.x, cluster.y, cluster.z);
+	for(const MeasurementPackage& detection : detections)
+		CHECK(detection.timestamp_ == 1000, "detection of a scan stamped %lld", (long long)detection.timestamp_);
+
+	// the bare road returns nothing but ground
+	Lidar empty(std::vector<Car>(), 0);
+	std::vector<MeasurementPackage> ground = detector.detect(*empty.scan(), 0);
+	CHECK(ground.empty(), "%zu detections on the empty road", ground.size());
+}
+
+// cars driving through a sweep are detected where they were at their detection's time
+void checkSweep()
+{
+	std::vector<Car> start = highwayCars(), end = start;
+	const double period_s = 0.1;
+	const long long timestamp = 5000000;
+	for(Car& car : end)
+		car.move(period_s, (int)(period_s * 1e6));
+	Lidar lidar(start, 0);
+	LidarSweep sweep;
+	lidar.scanSweep(start, end, timestamp, period_s, sweep);
+	LidarDetector detector;
+	std::vector<MeasurementPackage> detections = detector.detect(sweep);
+
+	int outside = 0;
+	double worst = 0;
+	for(const MeasurementPackage& detection : detections)
+	{
+		outside += detection.timestamp_ < timestamp || detection.timestamp_ > timestamp + (long long)(period_s * 1e6);
+		// straight driving cars, so the interpolated position is exact
+		double s = (detection.timestamp_ - timestamp) / (period_s * 1e6);
+		std::vector<double> carX, carY;
+		for(size_t c = 0; c < start.size(); c++)
+		{
+			carX.push_back(start[c].position.x + s * (end[c].position.x - start[c].position.x));
+			carY.push_back(start[c].position.y + s * (end[c].position.y - start[c].position.y));
+		}
+		double nearest = 1e9;
+		for(size_t c = 0; c < start.size(); c++)
+			nearest = std::min(nearest, std::hypot(detection.raw_measurements_(0) - carX[c], detection.raw_measurements_(1) - carY[c]));
+		worst = std::max(worst, nearest);
+	}
+	std::printf("detect(sweep): %zu detections of %zu moving cars, farthest %.3f m from its car at the detection's time\n",
+		detections.size(), start.size(), worst);
+	CHECK(detections.size() == start.size(), "%zu detections of %zu cars", detections.size(), start.size());
+	CHECK(outside == 0, "%d detections stamped outside the sweep", outside);
+	CHECK(worst <= 0.5, "a detection is %g m from its car at its time", worst);
+}
+
+}
+
+int main()
+{
+	checkScan();
+	checkSweep();
+	return checkResult("check_lidar_detector");
+}
@@ -0,0 +1,300 @@
+// MeasurementIngest: reorder window order, late, rejected and forced counts, and feeding TrackerRuntime
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "../measurement_queue.h"
+#include "../tracker_runtime.h"
+
+namespace {
+
+Measurement make(long long timestamp, int track, double value = 0, double sequence = 0)
+{
+	Measurement measurement = Measurement();
+	measurement.timestamp = timestamp;
+	measurement.track = track;
+	measurement.sensor = MeasurementPackage::LASER;
+	measurement.size = 2;
+	measurement.values[0] = value;
+	measurement.values[1] = sequence;
+	return measurement;
+}
+
+// one thread, exact counts
+void checkSingleProducer()
+{
+	MeasurementIngest ingest(8, 100);
+	const long long timestamps[] = {500, 300, 400, 300, 700, 600, 1000, 900, 800};
+	int accepted = 0;
+	for(int i = 0; i < 9; i++)
+		accepted += ingest.submit(make(timestamps[i], i));
+	CHECK(accepted == 8 && ingest.stats.rejected == 1, "a queue of 8 took %d of 9, %lld rejected", accepted, ingest.stats.rejected.load());
+
+	std::vector<Measurement> batch;
+	int released = ingest.drain(700, batch);
+	// released up to now - window, equal timestamps in arrival order
+	const long long expected[] = {300, 300, 400, 500, 600};
+	const int tracks[] = {1, 3, 2, 0, 5};
+	CHECK(released == 5 && batch.size() == 5, "released %d measurements up to 600, expected 5", released);
+	for(size_t i = 0; i < batch.size() && i < 5; i++)
+		CHECK(batch[i].timestamp == expected[i] && batch[i].track == tracks[i], "release %zu is track %d at %lld, expected track %d at %lld",
+			i, batch[i].track, batch[i].timestamp, tracks[i], expected[i]);
+
+	// 550 is older than the released 600 and is dropped, 650 still fits in
+	ingest.submit(make(550, 10));
+	ingest.submit(make(650, 11));
+	batch.clear();
+	released = ingest.drain(LLONG_MAX, batch);
+	const long long rest[] = {650, 700, 900, 1000};
+	CHECK(released == 4 && batch.size() == 4, "released %d remaining measurements, expected 4", released);
+	for(size_t i = 0; i < batch.size() && i < 4; i++)
+		CHECK(batch[i].timestamp == rest[i], "release %zu at %lld, expected %lld", i, batch[i].timestamp, rest[i]);
+	CHECK(ingest.stats.late == 1, "%lld late measurements, expected 1", ingest.stats.late.load());
+	CHECK(ingest.stats.submitted == 10 && ingest.stats.dispatched == 9, "submitted %lld dispatched %lld, expected 10 and 9",
+		ingest.stats.submitted.load(), ingest.stats.dispatched.load());
+}
+
+// a full reorder window releases its earliest measurements before their time
+void checkReorderCapacity()
+{
+	MeasurementIngest ingest(8, 1000, 3);
+	const long long timestamps[] = {500, 300, 400, 200, 600};
+	for(int i = 0; i < 5; i++)
+		ingest.submit(make(timestamps[i], i));
+	std::vector<Measurement> batch;
+	int released = ingest.drain(0, batch);
+	CHECK(released == 2 && batch.size() == 2 && batch[0].timestamp == 200 && batch[1].timestamp == 300,
+		"a window of 3 released %d measurements early, expected 200 and 300", released);
+	CHECK(ingest.stats.forced == 2 && ingest.stats.maxReorderDepth == 3, "%lld forced, window depth %lld, expected 2 and 3",
+		ingest.stats.forced.load(), ingest.stats.maxReorderDepth.load());
+
+	// older than what was forced out is late, the rest waits for its time as usual
+	ingest.submit(make(250, 5));
+	batch.clear();
+	released = ingest.drain(LLONG_MAX, batch);
+	CHECK(released == 3 && batch.size() == 3 && batch[0].timestamp == 400 && batch[2].timestamp == 600,
+		"released %d after the forced ones, expected 400 to 600", released);
+	CHECK(ingest.stats.late == 1 && ingest.stats.forced == 2 && ingest.stats.dispatched == 5,
+		"late %lld forced %lld dispatched %lld, expected 1, 2 and 5", ingest.stats.late.load(), ingest.stats.forced.load(),
+		ingest.stats.dispatched.load());
+}
+
+/**
+ * Producers submit their own streams, each in time order but with
+ * neighbors swapped, retrying on a full queue and keeping pace with each
+ * other. The consumer releases up to
+ * the slowest producer's progress. Releases have to come out in time
+ * order, and every submitted measurement has to be released exactly once
+ * or counted late.
+ */
+void checkMultiProducer(int producers, int perProducer, long long window_us)
+{
+	const long long period_us = 100;
+	const size_t reorderCapacity = 4096;
+	MeasurementIngest ingest(1024, window_us, reorderCapacity);
+	std::vector<std::atomic<long long> > progress(producers);
+	for(std::atomic<long long>& p : progress)
+		p = -1;
+	std::atomic<long long> attempts(0);
+	std::atomic<int> running(producers);
+
+	// sensors run on the same clock: none gets further than lead ahead of the slowest
+	const long long lead_us = 256 * period_us;
+	auto slowest = [&]()
+	{
+		long long least = LLONG_MAX;
+		for(std::atomic<long long>& q : progress)
+			least = std::min(least, q.load(std::memory_order_acquire));
+		return least;
+	};
+	auto producer = [&](int p)
+	{
+		long long tries = 0;
+		for(int k = 0; k < perProducer; k++)
+		{
+			int swapped = k ^ 1;
+			long long timestamp = swapped * period_us + p;
+			while(timestamp > slowest() + lead_us)
+				std::this_thread::yield();
+			tries++;
+			while(!ingest.submit(make(timestamp, p, p, swapped)))
+			{
+				tries++;
+				std::this_thread::yield();
+			}
+			progress[p].store(std::max(progress[p].load(std::memory_order_relaxed), timestamp), std::memory_order_release);
+		}
+		attempts += tries;
+		running--;
+	};
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for(int p = 0; p < producers; p++)
+		threads.push_back(std::thread(producer, p));
+
+	std::vector<Measurement> released;
+	released.reserve((size_t)producers * perProducer);
+	for(;;)
+	{
+		bool done = running == 0;
+		long long now = LLONG_MAX;
+		for(std::atomic<long long>& p : progress)
+			now = std::min(now, p.load(std::memory_order_acquire));
+		ingest.drain(done ? LLONG_MAX : now, released);
+		if(done)
+			break;
+		std::this_thread::yield();
+	}
+	for(std::thread& thread : threads)
+		thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	const long long total = (long long)producers * perProducer;
+	long long late = ingest.stats.late, rejected = ingest.stats.rejected;
+	bool ordered = true;
+	std::vector<std::vector<char> > seen(producers, std::vector<char>(perProducer, 0));
+	long long duplicates = 0;
+	for(size_t i = 0; i < released.size(); i++)
+	{
+		ordered &= i == 0 || released[i-1].timestamp <= released[i].timestamp;
+		char& mark = seen[(int)released[i].values[0]][(int)released[i].values[1]];
+		duplicates += mark;
+		mark = 1;
+	}
+	std::printf("%d producers x %d, window %lld us: %zu released, %lld late, %lld rejected, %lld forced, queue depth %lld, reorder depth %lld, %.2g measurements/s\n",
+		producers, perProducer, window_us, released.size(), late, rejected, ingest.stats.forced.load(), ingest.stats.maxQueueDepth.load(),
+		ingest.stats.maxReorderDepth.load(), total / seconds);
+	CHECK(ordered, "releases are not in time order");
+	CHECK(duplicates == 0, "%lld measurements released twice", duplicates);
+	CHECK(ingest.stats.submitted == total, "%lld of %lld measurements submitted", ingest.stats.submitted.load(), total);
+	CHECK(rejected == attempts - total, "%lld rejected, %lld failed submits", rejected, attempts - total);
+	CHECK((long long)released.size() + late == total, "%zu released and %lld late of %lld", released.size(), late, total);
+	CHECK(ingest.stats.dispatched == (long long)released.size(), "dispatched counts %lld, released %zu",
+		ingest.stats.dispatched.load(), released.size());
+	CHECK(ingest.stats.maxReorderDepth <= (long long)reorderCapacity, "reorder window held %lld of at most %zu",
+		ingest.stats.maxReorderDepth.load(), reorderCapacity);
+}
+
+/**
+ * A lidar and a radar thread feed straight driving cars through the ingest
+ * into a region partitioned TrackerRuntime. The runtime has to end up with
+ * the same filters as one UKF per car fed the released measurements in
+ * order.
+ */
+void checkTrackerFeed()
+{
+	const int cars = 12, frames = 200;
+	const long long frame_us = 50000;
+	MeasurementIngest ingest(64, 2 * frame_us);
+	std::atomic<long long> progress[2];
+	progress[0] = progress[1] = -1;
+
+	auto sensor = [&](int kind)
+	{
+		for(int frame = 0; frame < frames; frame++)
+		{
+			long long timestamp = frame * frame_us + kind * 1000;
+			for(int car = 0; car < cars; car++)
+			{
+				double t = timestamp * 1e-6;
+				double x = -20 + 3*car + (5 + car) * t, y = -4 + 4*(car % 3);
+				MeasurementPackage package;
+				package.timestamp_ = timestamp;
+				if(kind == 0)
+				{
+					package.sensor_type_ = MeasurementPackage::LASER;
+					package.raw_measurements_ = Eigen::VectorXd(2);
+					package.raw_measurements_ << x + 0.1*std::sin(frame + car), y + 0.1*std::cos(frame * car);
+				}
+				else
+				{
+					double rho = std::sqrt(x*x + y*y);
+					package.sensor_type_ = MeasurementPackage::RADAR;
+					package.raw_measurements_ = Eigen::VectorXd(3);
+					package.raw_measurements_ << rho + 0.2*std::cos(frame + car), std::atan2(y, x), (5 + car) * x / rho;
+				}
+				while(!ingest.submit(Measurement::fromPackage(package, car)))
+					std::this_thread::yield();
+			}
+			progress[kind].store(timestamp, std::memory_order_release);
+		}
+	};
+	std::thread lidar(sensor, 0), radar(sensor, 1);
+
+	TrackerRuntime runtime(3, TrackerRuntime::BY_REGION, 10);
+	std::vector<Measurement> all, batch;
+	for(;;)
+	{
+		bool done = progress[0].load(std::memory_order_acquire) == (frames - 1) * frame_us
+			&& progress[1].load(std::memory_order_acquire) == (frames - 1) * frame_us + 1000;
+		batch.clear();
+		ingest.drain(done ? LLONG_MAX : std::min(progress[0].load(), progress[1].load()), batch);
+		runtime.process(batch);
+		all.insert(all.end(), batch.begin(), batch.end());
+		if(done)
+			break;
+		std::this_thread::yield();
+	}
+	lidar.join();
+	radar.join();
+
+	std::vector<UKF> serial(cars);
+	for(const Measurement& measurement : all)
+		serial[measurement.track].ProcessMeasurement(measurement.toPackage());
+
+	std::vector<long long> load = runtime.load();
+	long long processed = 0;
+	for(long long l : load)
+		processed += l;
+	int different = 0;
+	for(int car = 0; car < cars; car++)
+	{
+		const UKF* ukf = runtime.find(car);
+		different += !ukf || ukf->x_ != serial[car].x_ || ukf->P_ != serial[car].P_;
+	}
+	std::printf("TrackerRuntime fed through the ingest: %lld measurements, %lld late, %lld migrations, %d of %d filters differ from serial ones\n",
+		processed, ingest.stats.late.load(), runtime.migrations, different, cars);
+	CHECK(processed == ingest.stats.dispatched, "runtime processed %lld of %lld released", processed, ingest.stats.dispatched.load());
+	CHECK(ingest.stats.late == 0, "%lld measurements late with a window of two frames", ingest.stats.late.load());
+	CHECK(runtime.tracks() == (size_t)cars, "%zu tracks for %d cars", runtime.tracks(), cars);
+	CHECK(runtime.migrations > 0, "no track crossed a region");
+	CHECK(different == 0, "%d filters differ from serial ones", different);
+
+	// expired tracks are dropped, other tracks keep their filters and a dropped id starts over
+	for(int car = 0; car < cars; car += 2)
+		CHECK(runtime.remove(car), "track %d could not be removed", car);
+	CHECK(!runtime.remove(0) && !runtime.remove(cars), "removed an unknown track");
+	CHECK(runtime.tracks() == (size_t)cars / 2, "%zu tracks left after removing %d", runtime.tracks(), cars / 2);
+	int kept = 0;
+	for(int car = 0; car < cars; car++)
+	{
+		const UKF* ukf = runtime.find(car);
+		kept += car % 2 ? ukf && ukf->x_ == serial[car].x_ : !ukf;
+	}
+	CHECK(kept == cars, "%d of %d tracks found or gone as expected after removal", kept, cars);
+	MeasurementPackage again = all.back().toPackage();
+	runtime.process(std::vector<Measurement>(1, Measurement::fromPackage(again, 0)));
+	const UKF* restarted = runtime.find(0);
+	CHECK(restarted && restarted->health_.updates == 0 && runtime.tracks() == (size_t)cars / 2 + 1,
+		"a removed id does not start a new track");
+}
+
+}
+
+int main()
+{
+	checkSingleProducer();
+	checkReorderCapacity();
+	// late drops depend on the schedule: a producer preempted mid-submit holds back the queue behind it
+	checkMultiProducer(4, 200000, 100);
+	checkMultiProducer(4, 200000, 0);
+	checkTrackerFeed();
+	return checkResult("check_measurement_ingest");
+}
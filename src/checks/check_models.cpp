@@ -0,0 +1,164 @@
+// Filters driven only through the sensor model API, and the cost of each model
+
+#include <cmath>
+#include <cstdio>
+#include "check.h"
+#include "../ukf.h"
+
+namespace {
+
+// camera bearing to the target, a user model that cannot start a track on its own
+struct BearingModel : MeasurementModel<BearingModel> {
+	enum { kSize = 1 };
+
+	double std_phi;
+
+	explicit BearingModel(double setStdPhi) : std_phi(setStdPhi) {}
+
+	template <typename StateCol, typename MeasCol>
+	void MeasureImpl(const StateCol& x, MeasCol z_out) const
+	{
+		z_out(0) = std::atan2(x(1), x(0));
+	}
+
+	template <typename MeasVec>
+	void NormalizeImpl(MeasVec& z_diff) const
+	{
+		NormalizeAngles(z_diff.row(0));
+	}
+
+	Eigen::Matrix<double, kSize, kSize> NoiseCovarianceImpl() const
+	{
+		Eigen::Matrix<double, kSize, kSize> R;
+		R << std_phi*std_phi;
+		return R;
+	}
+};
+
+// a target driving straight at 5 m/s, noise free
+struct Target
+{
+	double x(long long t) const { return 10 + 5*std::cos(0.3)*t/1e6; }
+	double y(long long t) const { return 5 + 5*std::sin(0.3)*t/1e6; }
+};
+
+MeasurementPackage lidarAt(const Target& target, long long t)
+{
+	MeasurementPackage package;
+	package.sensor_type_ = MeasurementPackage::LASER;
+	package.timestamp_ = t;
+	package.raw_measurements_ = Eigen::VectorXd(2);
+	package.raw_measurements_ << target.x(t), target.y(t);
+	return package;
+}
+
+MeasurementPackage radarAt(const Target& target, long long t)
+{
+	double x = target.x(t), y = target.y(t);
+	double rho = std::sqrt(x*x + y*y);
+	MeasurementPackage package;
+	package.sensor_type_ = MeasurementPackage::RADAR;
+	package.timestamp_ = t;
+	package.raw_measurements_ = Eigen::VectorXd(3);
+	package.raw_measurements_ << rho, std::atan2(y, x), (x*5*std::cos(0.3) + y*5*std::sin(0.3)) / rho;
+	return package;
+}
+
+MeasurementPackage bearingAt(const Target& target, long long t)
+{
+	MeasurementPackage package;
+	package.timestamp_ = t;
+	package.raw_measurements_ = Eigen::VectorXd(1);
+	package.raw_measurements_ << std::atan2(target.y(t), target.x(t));
+	return package;
+}
+
+const long long kStep_us = 50000;
+
+}
+
+int main()
+{
+	Target target;
+	LidarModel lidar(0.15, 0.15);
+	RadarModel radar(0.3, 0.03, 0.3);
+	BearingModel bearing(0.01);
+
+	// lidar only, through the model API
+	{
+		UKF ukf;
+		double first = ukf.ProcessMeasurement(lidar, lidarAt(target, 0));
+		CHECK(ukf.is_initialized_, "first lidar measurement did not initialize the filter");
+		CHECK(first == 0, "initializing update returned NIS %g", first);
+		CHECK(std::fabs(ukf.x_(0) - target.x(0)) < 1e-5 && std::fabs(ukf.x_(1) - target.y(0)) < 1e-5, "initialized at %g %g", (double)ukf.x_(0), (double)ukf.x_(1));
+		bool nisPositive = true;
+		for(int k = 1; k < 40; k++)
+			nisPositive = nisPositive && ukf.ProcessMeasurement(lidar, lidarAt(target, k*kStep_us)) > 0;
+		long long end = 39*kStep_us;
+		CHECK(nisPositive, "lidar updates returned no NIS");
+		CHECK(std::fabs(ukf.x_(0) - target.x(end)) < 0.1 && std::fabs(ukf.x_(1) - target.y(end)) < 0.1,
+			"lidar track at %g %g, target at %g %g", (double)ukf.x_(0), (double)ukf.x_(1), target.x(end), target.y(end));
+		CHECK(std::fabs(ukf.x_(2) - 5) < 0.5, "lidar track speed %g, target 5", (double)ukf.x_(2));
+	}
+
+	// radar only, through the model API
+	{
+		UKF ukf;
+		ukf.ProcessMeasurement(radar, radarAt(target, 0));
+		CHECK(ukf.is_initialized_, "first radar measurement did not initialize the filter");
+		CHECK(std::fabs(ukf.x_(0) - target.x(0)) < 1e-5 && std::fabs(ukf.x_(1) - target.y(0)) < 1e-5,
+			"radar initialized at %g %g", (double)ukf.x_(0), (double)ukf.x_(1));
+		for(int k = 1; k < 40; k++)
+			ukf.ProcessMeasurement(radar, radarAt(target, k*kStep_us));
+		CHECK(std::fabs(ukf.x_(2) - 5) < 0.5, "radar track speed %g, target 5", (double)ukf.x_(2));
+	}
+
+	// the model API and the sensor type switch run the same arithmetic
+	{
+		UKF byModel, byType;
+		for(int k = 0; k < 40; k++)
+		{
+			long long t = k*kStep_us;
+			if(k % 2)
+			{
+				byModel.ProcessMeasurement(radar, radarAt(target, t));
+				byType.ProcessMeasurement(radarAt(target, t));
+			}
+			else
+			{
+				byModel.ProcessMeasurement(lidar, lidarAt(target, t));
+				byType.ProcessMeasurement(lidarAt(target, t));
+			}
+		}
+		double difference = (byModel.x_ - byType.x_).cwiseAbs().maxCoeff() + (byModel.P_ - byType.P_).cwiseAbs().maxCoeff();
+		CHECK(difference == 0, "model API and ProcessMeasurement differ by %g", difference);
+	}
+
+	// a sensor that cannot initialize says so, and updates once another one did
+	{
+		UKF ukf;
+		double nis = ukf.ProcessMeasurement(bearing, bearingAt(target, 0));
+		CHECK(nis == -1 && !ukf.is_initialized_, "bearing only start returned %g, initialized %d", nis, (int)ukf.is_initialized_);
+		ukf.ProcessMeasurement(lidar, lidarAt(target, kStep_us));
+		nis = ukf.ProcessMeasurement(bearing, bearingAt(target, 2*kStep_us));
+		CHECK(nis >= 0, "bearing update after lidar start returned %g", nis);
+	}
+
+	// cost of a predict and update per model
+	const long long calls = 20000;
+	UKF ukf;
+	ukf.ProcessMeasurement(lidar, lidarAt(target, 0));
+	long long t = 0;
+	double predict = nanosPerCall([&](long long) { ukf.Prediction(CtrvModel(), kStep_us/1e6); keep(ukf.x_); }, calls);
+	double lidarUpdate = nanosPerCall([&](long long) { t += kStep_us; keep(ukf.ProcessMeasurement(lidar, lidarAt(target, t))); }, calls);
+	double radarUpdate = nanosPerCall([&](long long) { t += kStep_us; keep(ukf.ProcessMeasurement(radar, radarAt(target, t))); }, calls);
+	double bearingUpdate = nanosPerCall([&](long long) { t += kStep_us; keep(ukf.ProcessMeasurement(bearing, bearingAt(target, t))); }, calls);
+	std::printf("%-20s %10s\n", "model", "ns/call");
+	std::printf("%-20s %10.0f\n", "CtrvModel predict", predict);
+	std::printf("%-20s %10.0f\n", "LidarModel", lidarUpdate);
+	std::printf("%-20s %10.0f\n", "RadarModel", radarUpdate);
+	std::printf("%-20s %10.0f\n", "BearingModel", bearingUpdate);
+	std::printf("(update rows include the prediction to the measurement time)\n");
+
+	return checkResult("check_models");
+}
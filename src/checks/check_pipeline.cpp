@@ -0,0 +1,165 @@
+// Pipeline: frames in flight, stage order, and SensorPipeline tracking the same as a serial run
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "../event_queue.h"
+#include "../kinematics.h"
+#include "../scenario.h"
+#include "../sensor_pipeline.h"
+
+namespace {
+
+// a frame that records which stages ran on it
+struct Probe
+{
+	int index;
+	std::vector<int> stages;
+};
+
+/**
+ * Every stage has to see every frame in submission order, each frame has
+ * to go through the stages in order, and no more than maxInFlight frames
+ * may be between submit and completion at once
+ */
+void checkOrder(int maxInFlight)
+{
+	const int numStages = 4, frames = 2000;
+	std::atomic<int> inFlight(0), mostInFlight(0);
+	std::vector<int> lastSeen(numStages, -1);
+	int outOfOrder = 0, completed = 0, wrongStages = 0;
+
+	std::vector<Pipeline<Probe>::Stage> stages;
+	for(int s = 0; s < numStages; s++)
+	{
+		stages.push_back([&, s](Probe& probe)
+		{
+			// between entering the first stage and completion a frame holds one of the maxInFlight slots
+			if(s == 0)
+			{
+				int now = ++inFlight;
+				int most = mostInFlight;
+				while(now > most && !mostInFlight.compare_exchange_weak(most, now))
+					;
+			}
+			// only this stage's thread touches lastSeen[s]
+			outOfOrder += probe.index != lastSeen[s] + 1;
+			lastSeen[s] = probe.index;
+			probe.stages.push_back(s);
+			// a slow last stage backs frames up until submit has to block
+			if(s == numStages - 1)
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+		});
+	}
+	auto done = [&](const Probe& probe, long long)
+	{
+		bool inOrder = (int)probe.stages.size() == numStages;
+		for(int s = 0; inOrder && s < numStages; s++)
+			inOrder = probe.stages[s] == s;
+		wrongStages += !inOrder;
+		outOfOrder += probe.index != completed;
+		completed++;
+		inFlight--;
+	};
+	{
+		Pipeline<Probe> pipeline(stages, maxInFlight, done);
+		for(int k = 0; k < frames; k++)
+		{
+			Probe probe;
+			probe.index = k;
+			pipeline.submit(probe);
+		}
+		pipeline.flush();
+		CHECK(completed == frames, "%d of %d frames completed after flush", completed, frames);
+	}
+	std::printf("Pipeline with %d in flight: %d frames, at most %d in flight\n", maxInFlight, frames, mostInFlight.load());
+	CHECK(mostInFlight <= maxInFlight, "%d frames in flight with maxInFlight %d", mostInFlight.load(), maxInFlight);
+	CHECK(mostInFlight == maxInFlight, "stages never overlapped, at most %d of %d frames in flight", mostInFlight.load(), maxInFlight);
+	CHECK(outOfOrder == 0, "%d frames seen out of submission order", outOfOrder);
+	CHECK(wrongStages == 0, "%d frames did not run the stages in order", wrongStages);
+}
+
+// ids, states and times of the tracks every frame reported
+std::vector<std::vector<TrackSummary> > runHighway(int maxInFlight, int frames)
+{
+	Scenario scenario = Scenario::highway();
+	KinematicsWorld world;
+	ActuationQueue actuations;
+	std::vector<Car> traffic;
+	for(size_t i = 0; i < scenario.cars.size(); i++)
+	{
+		const ScenarioCar& sc = scenario.cars[i];
+		traffic.push_back(Car(Vect3(sc.x, sc.y, 0), Vect3(4, 2, 2), Color(0, 0, 1), sc.velocity, sc.angle, 2, "car"+std::to_string(i+1)));
+		int index = world.add(sc.x, sc.y, sc.velocity, sc.angle, 2);
+		for(uint32_t e = sc.firstEvent; e < sc.firstEvent + sc.numEvents; e++)
+			actuations.push(scenario.events[e].time_us, index, scenario.events[e].acceleration, scenario.events[e].steering);
+	}
+
+	SensorPipelineConfig config;
+	config.maxInFlight = maxInFlight;
+	std::vector<std::vector<TrackSummary> > tracks;
+	SensorPipeline pipeline(config, [&](const SensorFrame& frame, long long) { tracks.push_back(frame.tracks); });
+	const long long period_us = (long long)(config.period_s * 1e6);
+	for(int frame = 0; frame < frames; frame++)
+	{
+		long long timestamp = frame * period_us;
+		std::vector<Car> start = traffic;
+		actuations.applyDue(timestamp, world);
+		world.step(config.period_s);
+		for(size_t i = 0; i < traffic.size(); i++)
+			traffic[i].setPose(world.x[i], world.y[i], world.velocity[i], world.angle[i], world.cosAngle[i], world.sinAngle[i]);
+		pipeline.submit(timestamp, start, traffic);
+	}
+	pipeline.flush();
+	return tracks;
+}
+
+/**
+ * Association gates on velocities that lag by up to maxInFlight frames. On
+ * the highway scene the cars are far enough apart that the lag must not
+ * change a single association, so pipelining changes nothing in the tracks.
+ */
+void checkSerialEquivalence()
+{
+	const int frames = 60;
+	std::vector<std::vector<TrackSummary> > serial = runHighway(1, frames), pipelined = runHighway(3, frames);
+	int different = 0;
+	size_t reported = 0;
+	for(int frame = 0; frame < frames && frame < (int)serial.size() && frame < (int)pipelined.size(); frame++)
+	{
+		std::vector<TrackSummary>& a = serial[frame];
+		std::vector<TrackSummary>& b = pipelined[frame];
+		reported += a.size();
+		// reported in hash map order, compare by id
+		auto byId = [](const TrackSummary& l, const TrackSummary& r) { return l.id < r.id; };
+		std::sort(a.begin(), a.end(), byId);
+		std::sort(b.begin(), b.end(), byId);
+		bool same = a.size() == b.size();
+		for(size_t i = 0; same && i < a.size(); i++)
+			same = a[i].id == b[i].id && a[i].x == b[i].x && a[i].y == b[i].y && a[i].vx == b[i].vx && a[i].vy == b[i].vy
+				&& a[i].timestamp == b[i].timestamp;
+		different += !same;
+	}
+	std::printf("SensorPipeline on the highway scene: %zu track reports over %d frames, %d frames differ between 1 and 3 in flight\n",
+		reported, frames, different);
+	CHECK(serial.size() == (size_t)frames && pipelined.size() == (size_t)frames, "%zu and %zu of %d frames completed",
+		serial.size(), pipelined.size(), frames);
+	CHECK(reported > 0, "no tracks reported");
+	CHECK(different == 0, "%d frames report different tracks with 3 frames in flight than serially", different);
+}
+
+}
+
+int main()
+{
+	checkOrder(1);
+	checkOrder(3);
+	checkSerialEquivalence();
+	return checkResult("check_pipeline");
+}
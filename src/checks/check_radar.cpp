@@ -0,0 +1,200 @@
+// Radar: fastAtan2 error bound, precision far from the origin, tracking from its packages and cost of the batched kernel
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "../sensors/radar.h"
+#include "../ukf.h"
+
+namespace {
+
+// largest |fastAtan2 - atan2| over a dense sweep of directions and random points
+double atan2Error()
+{
+	double worst = 0;
+	const double radii[] = {1e-20, 1e-3, 1, 150, 1e6, 1e20};
+	for(double radius : radii)
+	{
+		for(int k = 0; k <= 200000; k++)
+		{
+			double angle = -M_PI + 2*M_PI*k/200000;
+			float y = (float)(radius*std::sin(angle)), x = (float)(radius*std::cos(angle));
+			worst = std::max(worst, std::fabs(Radar::fastAtan2(y, x) - std::atan2((double)y, (double)x)));
+		}
+	}
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> coordinate(-200, 200);
+	for(int k = 0; k < 1000000; k++)
+	{
+		float y = coordinate(generator), x = coordinate(generator);
+		worst = std::max(worst, std::fabs(Radar::fastAtan2(y, x) - std::atan2((double)y, (double)x)));
+	}
+	// the axes and the diagonals
+	const float edges[][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}, {-0.0f, -1}};
+	for(const float* edge : edges)
+		worst = std::max(worst, std::fabs(Radar::fastAtan2(edge[0], edge[1]) - std::atan2((double)edge[0], (double)edge[1])));
+	return worst;
+}
+
+RadarConfig noiseFree()
+{
+	RadarConfig config;
+	config.stdRho = config.stdPhi = config.stdRhoDot = 0;
+	config.maxRange = 1e6f;
+	return config;
+}
+
+// cars a few meters from an ego car far from the world origin, against the measurements in double
+void checkFarFromOrigin()
+{
+	const double origins[] = {0, 1e4 + 0.1, 1e5 + 0.3, 1e6 + 0.7};
+	const double offsets[][2] = {{7.31, 0}, {0.013, 9.77}, {-3.1, -4.27}, {42.123, 17.009}};
+	for(double origin : origins)
+	{
+		KinematicsWorld world;
+		for(const double* offset : offsets)
+			world.add(origin + offset[0], origin + offset[1], 5, 0.2f, 2);
+		RadarPose pose = {origin, origin, 0, 0, 0};
+		RadarReturns returns;
+		Radar radar(noiseFree());
+		radar.scan(world, pose, 0, returns);
+		CHECK(returns.size() == world.size(), "%zu returns at origin %g", returns.size(), origin);
+		for(size_t i = 0; i < returns.size(); i++)
+		{
+			double dx = world.x[i] - origin, dy = world.y[i] - origin;
+			double rho = std::sqrt(dx*dx + dy*dy);
+			double rhoDot = (dx*world.velocity[i]*world.cosAngle[i] + dy*world.velocity[i]*world.sinAngle[i])/rho;
+			CHECK(std::fabs(returns.rho[i] - rho) < 1e-5*rho, "range %.7g at origin %g, expected %.7g", returns.rho[i], origin, rho);
+			CHECK(std::fabs(returns.phi[i] - std::atan2(dy, dx)) < 2e-6, "bearing %.7g at origin %g, expected %.7g", returns.phi[i], origin, std::atan2(dy, dx));
+			CHECK(std::fabs(returns.rhoDot[i] - rhoDot) < 1e-5, "range rate %.7g at origin %g, expected %.7g", returns.rhoDot[i], origin, rhoDot);
+		}
+	}
+}
+
+
+/**
+ * Track a car with a UKF fed package() of a radar that may be away from
+ * the origin, turned and moving
+ * @return position and velocity RMSE over the last half of the run
+ */
+void trackFromPackages(const RadarPose& start, double* positionRmse, double* velocityRmse)
+{
+	// the same course in the radar's frame for every pose, so only the frame changes
+	KinematicsWorld world;
+	const double c = std::cos(start.yaw), s = std::sin(start.yaw);
+	world.add(start.x + 25*c - 8*s, start.y + 25*s + 8*c, 12, start.yaw - 0.3f, 2);
+	world.setActuation(0, 0.5f, 0.05f);
+	// far enough that the car stays in range while the radar drives away from it
+	RadarConfig config;
+	config.maxRange = 300;
+	Radar radar(config, 3);
+	UKF ukf;
+	RadarReturns returns;
+	const float dt = 0.05f;
+	const int frames = 200;
+	double squaredPosition = 0, squaredVelocity = 0;
+	for(int frame = 0; frame < frames; frame++)
+	{
+		double t = frame * dt;
+		RadarPose pose = {start.x + start.vx * t, start.y + start.vy * t, start.yaw, start.vx, start.vy};
+		radar.scan(world, pose, (long long)(frame * dt * 1e6), returns);
+		for(size_t i = 0; i < returns.size(); i++)
+			ukf.ProcessMeasurement(returns.package(i));
+		if(frame >= frames / 2)
+		{
+			double ex = ukf.x_(0) - world.x[0], ey = ukf.x_(1) - world.y[0];
+			double evx = ukf.x_(2)*std::cos(ukf.x_(3)) - world.velocity[0]*world.cosAngle[0];
+			double evy = ukf.x_(2)*std::sin(ukf.x_(3)) - world.velocity[0]*world.sinAngle[0];
+			squaredPosition += ex*ex + ey*ey;
+			squaredVelocity += evx*evx + evy*evy;
+		}
+		world.step(dt);
+	}
+	*positionRmse = std::sqrt(squaredPosition / (frames / 2));
+	*velocityRmse = std::sqrt(squaredVelocity / (frames / 2));
+}
+
+}
+
+int main()
+{
+	double error = atan2Error();
+	std::printf("fastAtan2 largest error %.2g rad\n", error);
+	CHECK(error <= 1e-6, "fastAtan2 is off by %g rad", error);
+
+	checkFarFromOrigin();
+
+	// the radar at the origin facing along x, then offset and turned, then also driving
+	const RadarPose poses[] = {{0, 0, 0, 0, 0}, {-40, 6, 0.7f, 0, 0}, {100, -30, -2.5f, 0, 0}, {-40, 6, 0.7f, 8, -1}, {100, -30, -2.5f, -3, 2}};
+	double referencePosition = 0, referenceVelocity = 0;
+	for(const RadarPose& pose : poses)
+	{
+		double positionRmse, velocityRmse;
+		trackFromPackages(pose, &positionRmse, &velocityRmse);
+		std::printf("UKF on packages of a radar at (%g, %g) yaw %g moving (%g, %g): position RMSE %.3f m, velocity RMSE %.3f m/s\n",
+			pose.x, pose.y, pose.yaw, pose.vx, pose.vy, positionRmse, velocityRmse);
+		if(pose.x == 0 && pose.yaw == 0)
+		{
+			referencePosition = positionRmse;
+			referenceVelocity = velocityRmse;
+		}
+		// a standing radar sees the same returns in its frame, a driving one a different relative course
+		double slack = pose.vx == 0 && pose.vy == 0 ? 1.1 : 2;
+		CHECK(positionRmse < slack*referencePosition && velocityRmse < slack*referenceVelocity,
+			"tracking from a radar at (%g, %g) yaw %g: RMSE %.3f m %.3f m/s, at the origin %.3f m %.3f m/s",
+			pose.x, pose.y, pose.yaw, positionRmse, velocityRmse, referencePosition, referenceVelocity);
+	}
+
+	// the batched kernel against the same measurements with libm, per car
+	const int cars = 10000;
+	KinematicsWorld world;
+	std::mt19937 generator(2);
+	std::uniform_real_distribution<double> position(-100, 100);
+	for(int i = 0; i < cars; i++)
+		world.add(position(generator), position(generator), 20, (float)(i % 7), 2);
+	RadarPose pose = {1, -2, 0.3f, 10, 0};
+	std::vector<float> batchedRho(cars), batchedPhi(cars), batchedRhoDot(cars);
+	double batched = nanosPerCall([&](long long)
+	{
+		Radar::measureKernel(cars, world.x.data(), world.y.data(), world.velocity.data(), world.cosAngle.data(), world.sinAngle.data(),
+			pose, batchedRho.data(), batchedPhi.data(), batchedRhoDot.data());
+		keep(batchedPhi[0]);
+	}, 200) / cars;
+	RadarReturns returns;
+	Radar radar(noiseFree());
+	double scan = nanosPerCall([&](long long) { radar.scan(world, pose, 0, returns); keep(returns.rho[0]); }, 200) / cars;
+
+	std::vector<float> rho(cars), phi(cars), rhoDot(cars);
+	double scalar = nanosPerCall([&](long long)
+	{
+		for(int i = 0; i < cars; i++)
+		{
+			double dx = world.x[i] - pose.x, dy = world.y[i] - pose.y;
+			double r = std::sqrt(dx*dx + dy*dy);
+			double vx = world.velocity[i]*world.cosAngle[i] - pose.vx, vy = world.velocity[i]*world.sinAngle[i] - pose.vy;
+			rho[i] = (float)r;
+			rhoDot[i] = (float)((dx*vx + dy*vy)/r);
+			phi[i] = (float)std::atan2(dy*std::cos(pose.yaw) - dx*std::sin(pose.yaw), dx*std::cos(pose.yaw) + dy*std::sin(pose.yaw));
+		}
+		keep(phi[0]);
+	}, 200) / cars;
+
+	float worstRho = 0, worstPhi = 0;
+	for(int i = 0; i < cars; i++)
+	{
+		worstRho = std::max(worstRho, std::fabs(batchedRho[i] - rho[i]));
+		worstPhi = std::max(worstPhi, std::fabs(batchedPhi[i] - phi[i]));
+	}
+	std::printf("%-28s %8s\n", "ns per car", "");
+	std::printf("%-28s %8.2f\n", "measureKernel", batched);
+	std::printf("%-28s %8.2f\n", "scalar loop with libm", scalar);
+	std::printf("%-28s %8.2f\n", "Radar::scan, noise included", scan);
+	std::printf("measureKernel vs libm: largest difference rho %.2g m, phi %.2g rad\n", worstRho, worstPhi);
+	CHECK(returns.size() == (size_t)cars, "%zu of %d cars returned", returns.size(), cars);
+	CHECK(worstRho < 1e-4f && worstPhi < 2e-6f, "measureKernel differs from libm by %g m, %g rad", worstRho, worstPhi);
+	CHECK(batched < scalar, "measureKernel takes %.2f ns per car, the libm loop %.2f", batched, scalar);
+
+	return checkResult("check_radar");
+}
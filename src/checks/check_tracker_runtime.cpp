@@ -0,0 +1,107 @@
+// TrackerRuntime: generated traffic tracked by sharded workers the same as by one filter per car
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "../event_queue.h"
+#include "../kinematics.h"
+#include "../scenario.h"
+#include "../tracker_runtime.h"
+
+namespace {
+
+/**
+ * Lidar frames of generated traffic, in time order. Car i is first seen
+ * in frame i % 60, so tracks keep starting while others run.
+ */
+std::vector<std::vector<Measurement> > lidarFrames(int cars, double duration_s, double rate_hz)
+{
+	Scenario scenario = Scenario::generate(cars, 7);
+	KinematicsWorld world;
+	ActuationQueue actuations;
+	for(size_t i = 0; i < scenario.cars.size(); i++)
+	{
+		const ScenarioCar& sc = scenario.cars[i];
+		int index = world.add(sc.x, sc.y, sc.velocity, sc.angle, 2);
+		for(uint32_t e = sc.firstEvent; e < sc.firstEvent + sc.numEvents; e++)
+			actuations.push(scenario.events[e].time_us, index, scenario.events[e].acceleration, scenario.events[e].steering);
+	}
+
+	std::mt19937 generator(8);
+	std::normal_distribution<double> noise(0, 0.15);
+	const int numFrames = (int)(duration_s * rate_hz);
+	std::vector<std::vector<Measurement> > frames(numFrames);
+	for(int frame = 0; frame < numFrames; frame++)
+	{
+		long long timestamp = (long long)(frame * 1e6 / rate_hz);
+		actuations.applyDue(timestamp, world);
+		for(int car = 0; car < (int)world.size(); car++)
+		{
+			if(frame < car % 60)
+				continue;
+			MeasurementPackage package;
+			package.timestamp_ = timestamp;
+			package.sensor_type_ = MeasurementPackage::LASER;
+			package.raw_measurements_ = Eigen::VectorXd(2);
+			package.raw_measurements_ << world.x[car] + noise(generator), world.y[car] + noise(generator);
+			frames[frame].push_back(Measurement::fromPackage(package, car));
+		}
+		world.step(1 / rate_hz);
+	}
+	return frames;
+}
+
+/**
+ * Run the frames through a runtime and through one UKF per car fed in
+ * the same order; every filter has to match bit for bit and start its
+ * clock at its first measurement
+ */
+void checkPartition(const std::vector<std::vector<Measurement> >& frames, int cars, TrackerRuntime::Partition partition)
+{
+	const char* name = partition == TrackerRuntime::BY_REGION ? "BY_REGION" : "BY_TRACK_ID";
+	TrackerRuntime runtime(4, partition, 20);
+	std::vector<UKF> serial(cars);
+	int lateClocks = 0;
+	for(const std::vector<Measurement>& frame : frames)
+	{
+		runtime.process(frame);
+		for(const Measurement& measurement : frame)
+		{
+			serial[measurement.track].ProcessMeasurement(measurement.toPackage());
+			const UKF* ukf = runtime.find(measurement.track);
+			lateClocks += !ukf || ukf->time_us_ != measurement.timestamp;
+		}
+	}
+
+	int different = 0;
+	for(int car = 0; car < cars; car++)
+	{
+		const UKF* ukf = runtime.find(car);
+		different += !ukf || ukf->x_ != serial[car].x_ || ukf->P_ != serial[car].P_;
+	}
+	std::vector<long long> load = runtime.load();
+	long long most = *std::max_element(load.begin(), load.end()), least = *std::min_element(load.begin(), load.end());
+	std::printf("%s: %d cars over %zu frames on %d workers, %lld migrations, %d of %d filters differ from serial ones, load %lld to %lld\n",
+		name, cars, frames.size(), runtime.workers(), runtime.migrations, different, cars, least, most);
+	CHECK(runtime.tracks() == (size_t)cars, "%s: %zu tracks for %d cars", name, runtime.tracks(), cars);
+	CHECK(different == 0, "%s: %d filters differ from serial ones", name, different);
+	CHECK(lateClocks == 0, "%s: %d filters not at the time of their last measurement", name, lateClocks);
+	if(partition == TrackerRuntime::BY_REGION)
+		CHECK(runtime.migrations > 0, "BY_REGION: no track crossed a stripe");
+	else
+		CHECK(runtime.migrations == 0, "BY_TRACK_ID: %lld tracks moved", runtime.migrations);
+	CHECK(least > 0 && most < 2 * least, "%s: workers processed %lld to %lld measurements", name, least, most);
+}
+
+}
+
+int main()
+{
+	const int cars = 400;
+	std::vector<std::vector<Measurement> > frames = lidarFrames(cars, 10, 30);
+	checkPartition(frames, cars, TrackerRuntime::BY_REGION);
+	checkPartition(frames, cars, TrackerRuntime::BY_TRACK_ID);
+	return checkResult("check_tracker_runtime");
+}
@@ -0,0 +1,125 @@
+// Every sigma point set reproduces the mean and covariance of a known Gaussian, and Symmetric rejects parameters without one
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include "check.h"
+#include "../unscented_transform.h"
+
+namespace {
+
+/**
+ * Spread sigma points around mean with covariance P through the
+ * transform's unit offsets and recover mean and covariance from them
+ * @return largest error of the recovered moments, relative to their scale
+ */
+template <typename Scalar>
+double momentError(const typename UnscentedTransformParams<Scalar>::Ptr& ut, double* meanError, double* covarianceError)
+{
+	typedef typename UnscentedTransformParams<Scalar>::MatrixX MatrixX;
+	typedef typename UnscentedTransformParams<Scalar>::VectorX VectorX;
+	const int n = ut->n_;
+
+	// a correlated Gaussian: P = A A^T + I, mean 1..n
+	MatrixX A(n, n);
+	for(int i = 0; i < n; i++)
+		for(int j = 0; j < n; j++)
+			A(i, j) = Scalar(std::sin(1.0 + i*n + j));
+	MatrixX P = A * A.transpose() + MatrixX::Identity(n, n);
+	VectorX mean(n);
+	for(int i = 0; i < n; i++)
+		mean(i) = Scalar(i + 1);
+
+	MatrixX L = P.llt().matrixL();
+	MatrixX X = L * ut->unit_sigma_;
+	X.colwise() += mean;
+
+	VectorX recoveredMean = X * ut->weights_m_;
+	MatrixX deviation = X.colwise() - recoveredMean;
+	MatrixX recoveredP = deviation * ut->weights_c_.asDiagonal() * deviation.transpose();
+
+	*meanError = (recoveredMean - mean).cwiseAbs().maxCoeff() / mean.cwiseAbs().maxCoeff();
+	*covarianceError = (recoveredP - P).cwiseAbs().maxCoeff() / P.cwiseAbs().maxCoeff();
+	return std::max(*meanError, *covarianceError);
+}
+
+template <typename Scalar>
+void checkSet(const char* name, const typename UnscentedTransformParams<Scalar>::Ptr& ut, int expectedPoints, double tolerance)
+{
+	double meanError, covarianceError;
+	momentError<Scalar>(ut, &meanError, &covarianceError);
+	std::printf("%-40s %3d points  mean error %.1e  covariance error %.1e\n", name, ut->n_sig_, meanError, covarianceError);
+	CHECK(ut->n_sig_ == expectedPoints, "%s has %d sigma points, expected %d", name, ut->n_sig_, expectedPoints);
+	CHECK(std::fabs(ut->weights_m_.sum() - 1) < tolerance, "%s mean weights sum to %.9g", name, (double)ut->weights_m_.sum());
+	CHECK(meanError < tolerance, "%s recovers the mean with relative error %g", name, meanError);
+	CHECK(covarianceError < tolerance, "%s recovers the covariance with relative error %g", name, covarianceError);
+}
+
+// parameters that leave the symmetric set without a real spread or with weights divided by zero
+void checkRejected()
+{
+	typedef UnscentedTransformParams<double> UT;
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	// n, alpha, kappa
+	const double rejected[][3] = {{7, 1, -7}, {7, 1, -8}, {5, 0.5, -5.5}, {1, 1, -1}, {7, 0, 0}, {7, -1e-3, 0}, {7, -1, 3}, {7, nan, 0}, {7, 1, nan}};
+	for(const double* parameters : rejected)
+	{
+		bool threw = false;
+		try
+		{
+			UT::Symmetric((int)parameters[0], parameters[1], 2, parameters[2]);
+		}
+		catch(const std::invalid_argument&)
+		{
+			threw = true;
+		}
+		CHECK(threw, "Symmetric(n %g, alpha %g, kappa %g) was accepted", parameters[0], parameters[1], parameters[2]);
+	}
+	// the smallest spread that is still real is fine
+	bool threw = false;
+	try
+	{
+		UT::Symmetric(7, 1e-3, 2, -6.5);
+	}
+	catch(const std::invalid_argument&)
+	{
+		threw = true;
+	}
+	CHECK(!threw, "Symmetric(n 7, alpha 1e-3, kappa -6.5) was rejected");
+}
+
+}
+
+int main()
+{
+	typedef UnscentedTransformParams<double> UT;
+	typedef UnscentedTransformParams<float> UTf;
+	// the filter's augmented state and a few other dimensions
+	const int dimensions[] = {1, 2, 5, 7, 12};
+	for(int n : dimensions)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "n=%d Default", n);
+		checkSet<double>(name, UT::Default(n), 2*n+1, 1e-12);
+		std::snprintf(name, sizeof(name), "n=%d Symmetric alpha 1e-3 beta 2 kappa 0", n);
+		checkSet<double>(name, UT::Symmetric(n, 1e-3, 2, 0), 2*n+1, 1e-8);
+		std::snprintf(name, sizeof(name), "n=%d Symmetric alpha 0.5 beta 2 kappa 1", n);
+		checkSet<double>(name, UT::Symmetric(n, 0.5, 2, 1), 2*n+1, 1e-12);
+		std::snprintf(name, sizeof(name), "n=%d SphericalSimplex w0 0.2", n);
+		checkSet<double>(name, UT::SphericalSimplex(n, 0.2, 1, 0), n+2, 1e-12);
+		std::snprintf(name, sizeof(name), "n=%d SphericalSimplex w0 0 alpha 0.5", n);
+		checkSet<double>(name, UT::SphericalSimplex(n, 0, 0.5, 2), n+2, 1e-12);
+		std::snprintf(name, sizeof(name), "n=%d float Default", n);
+		checkSet<float>(name, UTf::Default(n), 2*n+1, 1e-5);
+		std::snprintf(name, sizeof(name), "n=%d float SphericalSimplex w0 0.2", n);
+		checkSet<float>(name, UTf::SphericalSimplex(n, 0.2, 1, 0), n+2, 1e-5);
+	}
+
+	// shared, not rebuilt per filter
+	CHECK(UT::Default(7) == UT::Default(7), "Default(7) is rebuilt on every call");
+
+	checkRejected();
+
+	return checkResult("check_unscented_transform");
+}
@@ -0,0 +1,129 @@
+// WrapAngle and NormalizeAngles: range on pathological inputs, NaN for non-finite ones and constant cost per call
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "../models.h"
+
+namespace {
+
+// the while loop UKF::norm used before, for reference only, never terminates on inf
+double legacyNorm(double val)
+{
+	while(val > M_PI)
+		val -= 2.*M_PI;
+	while(val < -M_PI)
+		val += 2.*M_PI;
+	return val;
+}
+
+template <typename Scalar>
+bool inRange(Scalar wrapped)
+{
+	return wrapped >= -Scalar(M_PI) && wrapped < Scalar(M_PI);
+}
+
+template <typename Scalar>
+void checkRange(const char* type)
+{
+	const Scalar pi = Scalar(M_PI);
+	const Scalar inf = std::numeric_limits<Scalar>::infinity();
+	const Scalar edges[] = {0, pi, -pi, std::nextafter(pi, Scalar(0)), std::nextafter(-pi, Scalar(0)),
+		std::nextafter(pi, Scalar(4)), std::nextafter(-pi, Scalar(-4)), 3*pi, -3*pi, Scalar(1e6), Scalar(-1e6),
+		Scalar(1e15), Scalar(-1e15), Scalar(1e30), Scalar(-1e30), std::numeric_limits<Scalar>::max(),
+		std::numeric_limits<Scalar>::lowest(), std::numeric_limits<Scalar>::denorm_min(), inf, -inf,
+		std::numeric_limits<Scalar>::quiet_NaN()};
+	for(Scalar value : edges)
+	{
+		Scalar wrapped = WrapAngle(value);
+		// a diverged filter has to stay visible, not turn into a heading of 0
+		if(std::isfinite(value))
+			CHECK(inRange(wrapped), "%s WrapAngle(%g) = %.9g", type, (double)value, (double)wrapped);
+		else
+			CHECK(std::isnan(wrapped), "%s WrapAngle(%g) = %.9g, expected NaN", type, (double)value, (double)wrapped);
+	}
+
+	// random magnitudes up to 1e6 rad land in range and on the same angle
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<double> exponent(-3, 6);
+	std::uniform_real_distribution<double> unit(-1, 1);
+	int outside = 0, wrong = 0;
+	for(int i = 0; i < 1000000; i++)
+	{
+		Scalar value = Scalar(unit(generator) * std::pow(10., exponent(generator)));
+		Scalar wrapped = WrapAngle(value);
+		outside += !inRange(wrapped);
+		double error = std::remainder((double)wrapped - (double)value, 2*M_PI);
+		wrong += std::fabs(error) > 4 * std::numeric_limits<Scalar>::epsilon() * std::max(1., std::fabs((double)value));
+	}
+	CHECK(outside == 0, "%s: %d of 1e6 random angles wrapped outside [-pi, pi)", type, outside);
+	CHECK(wrong == 0, "%s: %d of 1e6 random angles wrapped to a different angle", type, wrong);
+
+	// the row kernel the filter runs on sigma points
+	Eigen::Matrix<Scalar, 1, Eigen::Dynamic> row(sizeof(edges) / sizeof(edges[0]));
+	for(int i = 0; i < row.cols(); i++)
+		row(i) = edges[i];
+	NormalizeAngles(row);
+	for(int i = 0; i < row.cols(); i++)
+		CHECK(std::isfinite(edges[i]) ? inRange(row(i)) : std::isnan(row(i)), "%s NormalizeAngles(%g) = %.9g", type, (double)edges[i], (double)row(i));
+}
+
+// ns per WrapAngle over a table of inputs
+double wrapCost(const std::vector<double>& inputs)
+{
+	return nanosPerCall([&](long long i) { keep(WrapAngle(inputs[i & 1023])); }, 1000000);
+}
+
+std::vector<double> table(double magnitude, unsigned int seed)
+{
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<double> unit(-1, 1);
+	std::vector<double> inputs(1024);
+	for(double& input : inputs)
+		input = magnitude * unit(generator);
+	return inputs;
+}
+
+}
+
+int main()
+{
+	checkRange<double>("double");
+	checkRange<float>("float");
+
+	std::vector<double> normal = table(4, 2);
+	std::vector<double> corrupted = table(1e6, 3);
+	std::vector<double> huge = table(1e300, 4);
+	std::vector<double> nonFinite(1024);
+	for(size_t i = 0; i < nonFinite.size(); i++)
+		nonFinite[i] = i % 3 == 0 ? std::numeric_limits<double>::quiet_NaN() : i % 3 == 1 ? HUGE_VAL : -HUGE_VAL;
+
+	double normalCost = wrapCost(normal);
+	double corruptedCost = wrapCost(corrupted);
+	double hugeCost = wrapCost(huge);
+	double nonFiniteCost = wrapCost(nonFinite);
+	double legacyNormal = nanosPerCall([&](long long i) { keep(legacyNorm(normal[i & 1023])); }, 1000000);
+	double legacyCorrupted = nanosPerCall([&](long long i) { keep(legacyNorm(corrupted[i & 1023])); }, 1000, 1);
+
+	Eigen::MatrixXd Xdiff = Eigen::MatrixXd::Random(5, 15) * 1e6;
+	double rowCost = nanosPerCall([&](long long) { NormalizeAngles(Xdiff.row(3)); keep(Xdiff); }, 1000000) / Xdiff.cols();
+
+	std::printf("%-28s %10s %10s\n", "input", "WrapAngle", "while loop");
+	std::printf("%-28s %10.1f %10.1f\n", "|angle| < 4 rad", normalCost, legacyNormal);
+	std::printf("%-28s %10.1f %10.1f\n", "|angle| < 1e6 rad", corruptedCost, legacyCorrupted);
+	std::printf("%-28s %10.1f %10s\n", "|angle| < 1e300 rad", hugeCost, "-");
+	std::printf("%-28s %10.1f %10s\n", "inf, -inf, NaN", nonFiniteCost, "hangs");
+	std::printf("%-28s %10.1f\n", "NormalizeAngles, per angle", rowCost);
+	std::printf("(ns per call)\n");
+
+	// constant time: pathological inputs cost about what in-range ones do, a few ns of slack for timer noise
+	double bound = 2 * normalCost + 5;
+	CHECK(corruptedCost <= bound, "1e6 rad inputs take %.1f ns, in-range ones %.1f ns", corruptedCost, normalCost);
+	CHECK(hugeCost <= bound, "1e300 rad inputs take %.1f ns, in-range ones %.1f ns", hugeCost, normalCost);
+	CHECK(nonFiniteCost <= bound, "non-finite inputs take %.1f ns, in-range ones %.1f ns", nonFiniteCost, normalCost);
+
+	return checkResult("check_wrap_angle");
+}
@@ -0,0 +1,74 @@
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include <algorithm>
+#include <vector>
+#include "kinematics.h"
+
+struct ActuationEvent
+{
+	long long time_us;
+	// index of the car in the KinematicsWorld
+	int car;
+	float acceleration;
+	float steering;
+	// insertion order, keeps events with equal times in the order they were pushed
+	long long sequence;
+};
+
+/**
+ * Time sorted actuation events of all cars in one binary min-heap. Every
+ * frame pops exactly the events that are due, so a frame costs
+ * O(log n) per applied event and nothing for cars without one, and no
+ * event is lost when several fall into the same frame.
+ */
+class ActuationQueue
+{
+public:
+	ActuationQueue() : sequence(0) {}
+
+	void push(long long time_us, int car, float acceleration, float steering)
+	{
+		ActuationEvent event = {time_us, car, acceleration, steering, sequence++};
+		heap.push_back(event);
+		std::push_heap(heap.begin(), heap.end(), later);
+	}
+
+	void reserve(size_t n) { heap.reserve(n); }
+	size_t size() const { return heap.size(); }
+	bool empty() const { return heap.empty(); }
+
+	// time of the next pending event, only valid if not empty
+	long long nextTime() const { return heap.front().time_us; }
+
+	/**
+	 * Apply all events with time_us <= now in time order, later events of
+	 * the same car override earlier ones.
+	 * @return Number of events applied
+	 */
+	int applyDue(long long now, KinematicsWorld& world)
+	{
+		int applied = 0;
+		while(!heap.empty() && heap.front().time_us <= now)
+		{
+			const ActuationEvent& event = heap.front();
+			world.setActuation(event.car, event.acceleration, event.steering);
+			std::pop_heap(heap.begin(), heap.end(), later);
+			heap.pop_back();
+			applied++;
+		}
+		return applied;
+	}
+
+private:
+	// heap comparator, puts the earliest event on top
+	static bool later(const ActuationEvent& a, const ActuationEvent& b)
+	{
+		return a.time_us != b.time_us ? a.time_us > b.time_us : a.sequence > b.sequence;
+	}
+
+	std::vector<ActuationEvent> heap;
+	long long sequence;
+};
+
+#endif /* EVENT_QUEUE_H_ */
@@ -0,0 +1,47 @@
+#ifndef FRAME_SNAPSHOT_H_
+#define FRAME_SNAPSHOT_H_
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+struct CarSnapshot
+{
+	float x, y;
+	// rotation about z as the w and z parts of a quaternion, kept as plain
+	// floats so vectors of snapshots need no aligned allocator
+	float qw, qz;
+	bool visible;
+};
+
+struct TrackSnapshot
+{
+	struct Point { float x, y; };
+
+	// -1 for cars without a track
+	int node;
+	float px, py, v, yaw;
+	// predicted positions, evenly spaced up to the projected time
+	std::vector<Point> forecast;
+};
+
+/**
+ * Everything the renderer needs from one simulated frame. The simulation
+ * fills a snapshot in place and hands it over whole, so the renderer
+ * never reads state that is being written.
+ */
+struct FrameSnapshot
+{
+	long long timestamp;
+	// distance the ego car has traveled, scrolls the poles
+	double egoDistance;
+	std::vector<CarSnapshot> cars;
+	std::vector<TrackSnapshot> tracks;
+	double rmse[4];
+	bool pass;
+	double rmseFailLog[4];
+	// recorded traffic cloud when visualize_pcd is set, null otherwise
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
+};
+
+#endif /* FRAME_SNAPSHOT_H_ */
@@ -0,0 +1,212 @@
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include <cmath>
+#include <vector>
+#include "measurement_package.h"
+
+// rigid transform of the road plane, with the rotation kept as cosine and sine
+struct FrameTransform
+{
+	double x, y, yaw;
+	double cosYaw, sinYaw;
+
+	FrameTransform()
+		: x(0), y(0), yaw(0), cosYaw(1), sinYaw(0)
+	{}
+
+	FrameTransform(double setX, double setY, double setYaw)
+		: x(setX), y(setY), yaw(setYaw), cosYaw(std::cos(setYaw)), sinYaw(std::sin(setYaw))
+	{}
+
+	// other first, then this one, composed without trig
+	FrameTransform operator*(const FrameTransform& other) const
+	{
+		FrameTransform result;
+		result.x = x + cosYaw*other.x - sinYaw*other.y;
+		result.y = y + sinYaw*other.x + cosYaw*other.y;
+		result.yaw = yaw + other.yaw;
+		result.cosYaw = cosYaw*other.cosYaw - sinYaw*other.sinYaw;
+		result.sinYaw = sinYaw*other.cosYaw + cosYaw*other.sinYaw;
+		return result;
+	}
+
+	FrameTransform inverse() const
+	{
+		FrameTransform result;
+		result.x = -cosYaw*x - sinYaw*y;
+		result.y = sinYaw*x - cosYaw*y;
+		result.yaw = -yaw;
+		result.cosYaw = cosYaw;
+		result.sinYaw = -sinYaw;
+		return result;
+	}
+
+	void apply(double& px, double& py) const
+	{
+		double tx = x + cosYaw*px - sinYaw*py;
+		py = y + sinYaw*px + cosYaw*py;
+		px = tx;
+	}
+
+	// directions and velocities only turn
+	void rotate(double& vx, double& vy) const
+	{
+		double tx = cosYaw*vx - sinYaw*vy;
+		vy = sinYaw*vx + cosYaw*vy;
+		vx = tx;
+	}
+
+	// n points held as separate x and y arrays, transformed in place
+	void apply(int n, double* __restrict px, double* __restrict py) const
+	{
+		for(int i = 0; i < n; i++)
+		{
+			double tx = x + cosYaw*px[i] - sinYaw*py[i];
+			py[i] = y + sinYaw*px[i] + cosYaw*py[i];
+			px[i] = tx;
+		}
+	}
+};
+
+// odometry of the ego car, as from wheel speed and a yaw rate gyro
+struct EgoOdometry
+{
+	long long timestamp;
+	double velocity;
+	double yawRate;
+};
+
+/**
+ * Pose of the ego car in the world frame, dead reckoned from odometry with
+ * the same constant turn rate and velocity model the UKF tracks with. The
+ * world frame is the ego frame at the first odometry sample.
+ */
+class EgoMotion
+{
+public:
+
+	EgoMotion()
+		: velocity(0), yawRate(0), time_us(-1)
+	{}
+
+	void update(const EgoOdometry& odometry)
+	{
+		if(time_us >= 0)
+		{
+			double dt = (odometry.timestamp - time_us) / 1.0e6;
+			double yaw = pose.yaw;
+			double x = pose.x, y = pose.y;
+			if(std::fabs(yawRate) > 0.001)
+			{
+				x += velocity/yawRate * (std::sin(yaw + yawRate*dt) - pose.sinYaw);
+				y += velocity/yawRate * (pose.cosYaw - std::cos(yaw + yawRate*dt));
+			}
+			else
+			{
+				x += velocity*dt*pose.cosYaw;
+				y += velocity*dt*pose.sinYaw;
+			}
+			pose = FrameTransform(x, y, yaw + yawRate*dt);
+		}
+		time_us = odometry.timestamp;
+		velocity = odometry.velocity;
+		yawRate = odometry.yawRate;
+	}
+
+	// ego frame to world frame
+	const FrameTransform& egoToWorld() const { return pose; }
+
+	double velocityX() const { return velocity*pose.cosYaw; }
+	double velocityY() const { return velocity*pose.sinYaw; }
+	double getYawRate() const { return yawRate; }
+
+private:
+
+	FrameTransform pose;
+	double velocity;
+	double yawRate;
+	long long time_us;
+};
+
+/**
+ * Sensor, ego and world frames at one timestamp. The sensor to world
+ * transforms are composed once per update, so bringing a measurement into
+ * the world frame takes a few multiply-adds and no trig.
+ */
+class FrameSet
+{
+public:
+
+	// mount a sensor on the ego car and return its index
+	int addSensor(const FrameTransform& sensorToEgo)
+	{
+		mounts.push_back(sensorToEgo);
+		toWorld.push_back(sensorToEgo);
+		velocities.push_back(Velocity{0, 0});
+		return (int)mounts.size() - 1;
+	}
+
+	// refresh every sensor's transform and velocity for the ego's current pose
+	void update(const EgoMotion& ego)
+	{
+		egoToWorld = ego.egoToWorld();
+		for(size_t i = 0; i < mounts.size(); i++)
+		{
+			toWorld[i] = egoToWorld * mounts[i];
+			// the mount's lever arm adds yaw rate x arm to the ego velocity
+			double armX = toWorld[i].x - egoToWorld.x;
+			double armY = toWorld[i].y - egoToWorld.y;
+			velocities[i].vx = ego.velocityX() - ego.getYawRate()*armY;
+			velocities[i].vy = ego.velocityY() + ego.getYawRate()*armX;
+		}
+	}
+
+	const FrameTransform& sensorToWorld(int sensor) const { return toWorld[sensor]; }
+	const FrameTransform& ego() const { return egoToWorld; }
+
+	/**
+	 * Bring a measurement of the sensor into the world frame: a LASER
+	 * [px py] is transformed, a RADAR [rho phi rho_dot] keeps range and
+	 * range rate, its bearing turns by the sensor's heading, and the sensor's
+	 * position and velocity ride along for the measurement models
+	 */
+	void toWorldFrame(int sensor, MeasurementPackage& package) const
+	{
+		const FrameTransform& transform = toWorld[sensor];
+		if(package.sensor_type_ == MeasurementPackage::LASER)
+		{
+			transform.apply(package.raw_measurements_(0), package.raw_measurements_(1));
+		}
+		else
+		{
+			// RadarModel normalizes the bearing residual, no need to wrap here
+			package.raw_measurements_(1) += transform.yaw;
+		}
+		package.sensor_x_ = transform.x;
+		package.sensor_y_ = transform.y;
+		package.sensor_vx_ = velocities[sensor].vx;
+		package.sensor_vy_ = velocities[sensor].vy;
+	}
+
+	// a whole batch of measurements of one sensor
+	void toWorldFrame(int sensor, std::vector<MeasurementPackage>& packages) const
+	{
+		for(MeasurementPackage& package : packages)
+			toWorldFrame(sensor, package);
+	}
+
+private:
+
+	struct Velocity
+	{
+		double vx, vy;
+	};
+
+	FrameTransform egoToWorld;
+	std::vector<FrameTransform> mounts;
+	std::vector<FrameTransform> toWorld;
+	std::vector<Velocity> velocities;
+};
+
+#endif /* FRAMES_H_ */
@@ -2,20 +2,48 @@
 // Handle logic for creating traffic on highway and animating it
 
 #include "render/render.h"
+#include "render/scene.h"
+#include "event_queue.h"
+#include "frames.h"
+#include "kinematics.h"
 #include "sensors/lidar.h"
 #include "tools.h"
+#include "metrics.h"
+#include "scenario.h"
+#include "trace.h"
 
 class Highway
 {
 public:
 
 	std::vector<Car> traffic;
+	// kinematic state of traffic, stepped in bulk and copied back into the cars
+	KinematicsWorld world;
+	// pending actuation events of all traffic, indexed like world
+	ActuationQueue actuations;
 	Car egoCar;
 	Tools tools;
+	Metrics metrics;
 	bool pass = true;
 	std::vector<double> rmseThreshold = {0.30,0.16,0.95,0.70};
 	std::vector<double> rmseFailLog = {0.0,0.0,0.0,0.0};
 	Lidar* lidar;
+	// viewer the scene lives in
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	// retained shapes of the road, cars and tracks
+	Scene scene;
+	// snapshot reused by stepHighway
+	FrameSnapshot serialFrame;
+	int egoNode;
+	std::vector<int> carNodes;
+	// track node per tracked car, -1 for untracked ones
+	std::vector<int> trackNodes;
+	// ego pose from odometry and the sensor frames, for trackInWorldFrame
+	EgoMotion egoMotion;
+	FrameSet frames;
+	int egoSensor;
+	// world to ego frame now and at every forecast step
+	std::vector<FrameTransform> worldToEgoAhead;
 	
 	// Parameters 
 	// --------------------------------
@@ -28,127 +56,147 @@ public:
 	// Predict path in the future using UKF
 	double projectedTime = 2.0;
 	int projectedSteps = 6;
+	// Track in a world frame fixed to the road, with the ego car moving
+	// through it by odometry, instead of in the ego frame
+	bool trackInWorldFrame = false;
 	// --------------------------------
 
 	Highway(pcl::visualization::PCLVisualizer::Ptr& viewer)
-	{
+		: Highway(viewer, Scenario::highway())
+	{}
 
+	// traffic from a scenario, cars beyond the trackCars defaults are tracked
+	Highway(pcl::visualization::PCLVisualizer::Ptr& viewer, const Scenario& scenario)
+		: viewer(viewer), scene(viewer)
+	{
 		tools = Tools();
-	
+
 		egoCar = Car(Vect3(0, 0, 0), Vect3(4, 2, 2), Color(0, 1, 0), 0, 0, 2, "egoCar");
-		
-		Car car1(Vect3(-10, 4, 0), Vect3(4, 2, 2), Color(0, 0, 1), 5, 0, 2, "car1");
-		
-		std::vector<accuation> car1_instructions;
-		accuation a = accuation(0.5*1e6, 0.5, 0.0);
-		car1_instructions.push_back(a);
-		a = accuation(2.2*1e6, 0.0, -0.2);
-		car1_instructions.push_back(a);
-		a = accuation(3.3*1e6, 0.0, 0.2);
-		car1_instructions.push_back(a);
-		a = accuation(4.4*1e6, -2.0, 0.0);
-		car1_instructions.push_back(a);
-	
-		car1.setInstructions(car1_instructions);
-		if( trackCars[0] )
-		{
-			UKF ukf1;
-			car1.setUKF(ukf1);
-		}
-		traffic.push_back(car1);
-		
-		Car car2(Vect3(25, -4, 0), Vect3(4, 2, 2), Color(0, 0, 1), -6, 0, 2, "car2");
-		std::vector<accuation> car2_instructions;
-		a = accuation(4.0*1e6, 3.0, 0.0);
-		car2_instructions.push_back(a);
-		a = accuation(8.0*1e6, 0.0, 0.0);
-		car2_instructions.push_back(a);
-		car2.setInstructions(car2_instructions);
-		if( trackCars[1] )
-		{
-			UKF ukf2;
-			car2.setUKF(ukf2);
-		}
-		traffic.push_back(car2);
-	
-		Car car3(Vect3(-12, 0, 0), Vect3(4, 2, 2), Color(0, 0, 1), 1, 0, 2, "car3");
-		std::vector<accuation> car3_instructions;
-		a = accuation(0.5*1e6, 2.0, 1.0);
-		car3_instructions.push_back(a);
-		a = accuation(1.0*1e6, 2.5, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(3.2*1e6, 0.0, -1.0);
-		car3_instructions.push_back(a);
-		a = accuation(3.3*1e6, 2.0, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(4.5*1e6, 0.0, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(5.5*1e6, -2.0, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(7.5*1e6, 0.0, 0.0);
-		car3_instructions.push_back(a);
-		car3.setInstructions(car3_instructions);
-		if( trackCars[2] )
+
+		traffic.reserve(scenario.cars.size());
+		actuations.reserve(scenario.events.size());
+		trackCars.resize(scenario.cars.size(), true);
+		for(size_t i = 0; i < scenario.cars.size(); i++)
 		{
-			UKF ukf3;
-			car3.setUKF(ukf3);
+			const ScenarioCar& sc = scenario.cars[i];
+			traffic.push_back(Car(Vect3(sc.x, sc.y, 0), Vect3(4, 2, 2), Color(0, 0, 1), sc.velocity, sc.angle, 2, "car"+std::to_string(i+1)));
+
+			int index = world.add(sc.x, sc.y, sc.velocity, sc.angle, 2);
+			for(uint32_t e = sc.firstEvent; e < sc.firstEvent + sc.numEvents; e++)
+				actuations.push(scenario.events[e].time_us, index, scenario.events[e].acceleration, scenario.events[e].steering);
 		}
-		traffic.push_back(car3);
 
 		lidar = new Lidar(traffic,0);
-	
-		// render environment
-		renderHighway(0,viewer);
-		egoCar.render(viewer);
-		car1.render(viewer);
-		car2.render(viewer);
-		car3.render(viewer);
+		// lidar and radar both measure from the ego car's origin
+		egoSensor = frames.addSensor(FrameTransform());
+		tools.worldSensor = egoSensor;
+
+		// create all shapes once, frames only move them
+		scene.addHighway();
+		egoNode = scene.addCar(egoCar);
+		for(size_t i = 0; i < traffic.size(); i++)
+		{
+			carNodes.push_back(scene.addCar(traffic[i]));
+			trackNodes.push_back(trackCars[i] ? scene.addTrack(traffic[i].name, projectedSteps) : -1);
+		}
 	}
 	
-	void stepHighway(double egoVelocity, long long timestamp, int frame_per_sec, pcl::visualization::PCLVisualizer::Ptr& viewer)
+	/**
+	 * Advance traffic, sense, track and check the RMSE for one frame, and
+	 * describe the result in a snapshot for render(). Touches the viewer
+	 * only when visualize_lidar or visualize_radar is set.
+	 */
+	void simulate(double egoVelocity, long long timestamp, int frame_per_sec, FrameSnapshot& frame)
 	{
+		TRACE_SCOPE("Highway::simulate");
+		metrics.beginFrame();
+		ScopedLatency frameLatency(metrics.stage("frame"));
 
+		frame.timestamp = timestamp;
+		frame.egoDistance = egoVelocity*timestamp/1e6;
+		frame.cloud.reset();
 		if(visualize_pcd)
+			frame.cloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
+
 		{
-			pcl::PointCloud<pcl::PointXYZ>::Ptr trafficCloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
-			renderPointCloud(viewer, trafficCloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
+			ScopedLatency latency(metrics.stage("move"));
+			actuations.applyDue(timestamp, world);
+			world.step((double)1/frame_per_sec);
+			for(size_t i = 0; i < traffic.size(); i++)
+				traffic[i].setPose(world.x[i], world.y[i], world.velocity[i], world.angle[i], world.cosAngle[i], world.sinAngle[i]);
 		}
-		
 
-		// render highway environment with poles
-		renderHighway(egoVelocity*timestamp/1e6, viewer);
-		egoCar.render(viewer);
-		
+		tools.worldFrames = trackInWorldFrame ? &frames : nullptr;
+		if(trackInWorldFrame)
+			updateFrames(egoVelocity, timestamp);
+
+		frame.cars.resize(traffic.size());
+		frame.tracks.resize(traffic.size());
 		for (int i = 0; i < traffic.size(); i++)
 		{
-			traffic[i].move((double)1/frame_per_sec, timestamp);
-			if(!visualize_pcd)
-				traffic[i].render(viewer);
+			CarSnapshot& car = frame.cars[i];
+			car.x = traffic[i].position.x;
+			car.y = traffic[i].position.y;
+			car.qw = traffic[i].orientation.w();
+			car.qz = traffic[i].orientation.z();
+			car.visible = !visualize_pcd;
+
+			TrackSnapshot& track = frame.tracks[i];
+			track.node = trackCars[i] ? trackNodes[i] : -1;
 			// Sense surrounding cars with lidar and radar
 			if(trackCars[i])
 			{
 				VectorXd gt(4);
 				gt << traffic[i].position.x, traffic[i].position.y, traffic[i].velocity*cos(traffic[i].angle), traffic[i].velocity*sin(traffic[i].angle);
 				tools.ground_truth.push_back(gt);
-				tools.lidarSense(traffic[i], viewer, timestamp, visualize_lidar);
-				tools.radarSense(traffic[i], egoCar, viewer, timestamp, visualize_radar);
-				tools.ukfResults(traffic[i], viewer, projectedTime, projectedSteps);
+				// NIS is only meaningful for measurements that updated the filter
+				long updates = traffic[i].ukf.health_.updates;
+				{
+					ScopedLatency latency(metrics.stage("lidar"));
+					tools.lidarSense(traffic[i], viewer, timestamp, visualize_lidar);
+				}
+				if(traffic[i].ukf.health_.updates > updates)
+					metrics.recordNis(MeasurementPackage::LASER, traffic[i].ukf.NIS_lidar);
+				updates = traffic[i].ukf.health_.updates;
+				{
+					ScopedLatency latency(metrics.stage("radar"));
+					tools.radarSense(traffic[i], egoCar, viewer, timestamp, visualize_radar);
+				}
+				if(traffic[i].ukf.health_.updates > updates)
+					metrics.recordNis(MeasurementPackage::RADAR, traffic[i].ukf.NIS_radar);
+				{
+					// predicted path in the future, as Tools::ukfResults
+					ScopedLatency latency(metrics.stage("ukf_results"));
+					UKF ukf = traffic[i].ukf;
+					track.px = ukf.x_[0];
+					track.py = ukf.x_[1];
+					track.v = ukf.x_[2];
+					track.yaw = ukf.x_[3];
+					track.forecast.resize(projectedTime > 0 ? projectedSteps : 0);
+					for(size_t k = 0; k < track.forecast.size(); k++)
+					{
+						ukf.Prediction(projectedTime/projectedSteps);
+						track.forecast[k].x = ukf.x_[0];
+						track.forecast[k].y = ukf.x_[1];
+					}
+					if(trackInWorldFrame)
+						trackToEgoFrame(track);
+				}
 				VectorXd estimate(4);
 				double v  = traffic[i].ukf.x_(2);
     			double yaw = traffic[i].ukf.x_(3);
     			double v1 = cos(yaw)*v;
     			double v2 = sin(yaw)*v;
-				estimate << traffic[i].ukf.x_[0], traffic[i].ukf.x_[1], v1, v2;
+				double px = traffic[i].ukf.x_[0];
+				double py = traffic[i].ukf.x_[1];
+				if(trackInWorldFrame)
+					stateToEgoFrame(px, py, v1, v2);
+				estimate << px, py, v1, v2;
 				tools.estimations.push_back(estimate);
 	
 			}
 		}
-		viewer->addText("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
 		VectorXd rmse = tools.CalculateRMSE(tools.estimations, tools.ground_truth);
-		viewer->addText(" X: "+std::to_string(rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
-		viewer->addText(" Y: "+std::to_string(rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
-		viewer->addText("Vx: "	+std::to_string(rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
-		viewer->addText("Vy: "	+std::to_string(rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
 
 		if(timestamp > 1.0e6)
 		{
@@ -174,19 +222,109 @@ public:
 				pass = false;
 			}
 		}
-		if(!pass)
+		for(int k = 0; k < 4; k++)
 		{
-			viewer->addText("RMSE Failed Threshold", 30, 150, 20, 1, 0, 0, "rmse_fail");
-			if(rmseFailLog[0] > 0)
-				viewer->addText(" X: "+std::to_string(rmseFailLog[0]), 30, 125, 20, 1, 0, 0, "rmse_fail_x");
-			if(rmseFailLog[1] > 0)
-				viewer->addText(" Y: "+std::to_string(rmseFailLog[1]), 30, 100, 20, 1, 0, 0, "rmse_fail_y");
-			if(rmseFailLog[2] > 0)
-				viewer->addText("Vx: "+std::to_string(rmseFailLog[2]), 30, 75, 20, 1, 0, 0, "rmse_fail_vx");
-			if(rmseFailLog[3] > 0)
-				viewer->addText("Vy: "+std::to_string(rmseFailLog[3]), 30, 50, 20, 1, 0, 0, "rmse_fail_vy");
+			frame.rmse[k] = rmse[k];
+			frame.rmseFailLog[k] = rmseFailLog[k];
 		}
-		
+		frame.pass = pass;
+		metrics.endFrame();
+	}
+
+	/**
+	 * Dead reckon the ego car to timestamp and refresh the sensor frames,
+	 * and the world to ego transforms of the forecast horizon
+	 */
+	void updateFrames(double egoVelocity, long long timestamp)
+	{
+		TRACE_SCOPE("Highway::updateFrames");
+		EgoOdometry odometry{timestamp, egoVelocity, 0};
+		egoMotion.update(odometry);
+		frames.update(egoMotion);
+
+		// the ego car keeps its odometry over the forecast
+		worldToEgoAhead.resize(projectedSteps + 1);
+		EgoMotion ahead = egoMotion;
+		worldToEgoAhead[0] = egoMotion.egoToWorld().inverse();
+		for(int k = 1; k <= projectedSteps; k++)
+		{
+			odometry.timestamp = timestamp + (long long)(1e6 * projectedTime * k / projectedSteps);
+			ahead.update(odometry);
+			worldToEgoAhead[k] = ahead.egoToWorld().inverse();
+		}
+	}
+
+	// world frame position and velocity of a track to the ego frame, velocity relative to the ego car
+	void stateToEgoFrame(double& px, double& py, double& vx, double& vy) const
+	{
+		worldToEgoAhead[0].apply(px, py);
+		vx -= egoMotion.velocityX();
+		vy -= egoMotion.velocityY();
+		worldToEgoAhead[0].rotate(vx, vy);
+	}
+
+	void trackToEgoFrame(TrackSnapshot& track) const
+	{
+		double px = track.px, py = track.py;
+		double vx = track.v*cos(track.yaw), vy = track.v*sin(track.yaw);
+		stateToEgoFrame(px, py, vx, vy);
+		track.px = px;
+		track.py = py;
+		track.v = sqrt(vx*vx + vy*vy);
+		track.yaw = atan2(vy, vx);
+		for(size_t k = 0; k < track.forecast.size(); k++)
+		{
+			double fx = track.forecast[k].x, fy = track.forecast[k].y;
+			worldToEgoAhead[k+1].apply(fx, fy);
+			track.forecast[k].x = fx;
+			track.forecast[k].y = fy;
+		}
+	}
+
+	// show a simulated frame, must run on the thread that owns the viewer
+	void render(const FrameSnapshot& frame)
+	{
+		TRACE_SCOPE("Highway::render");
+		if(frame.cloud)
+			renderPointCloud(viewer, frame.cloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
+
+		// scroll the poles with the ego car
+		scene.updateHighway(frame.egoDistance);
+
+		for(size_t i = 0; i < frame.cars.size(); i++)
+		{
+			scene.updateCar(carNodes[i], frame.cars[i]);
+			if(frame.tracks[i].node >= 0)
+				scene.updateTrack(frame.tracks[i].node, frame.tracks[i]);
+		}
+
+		scene.text("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
+		scene.text(" X: "+std::to_string(frame.rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
+		scene.text(" Y: "+std::to_string(frame.rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
+		scene.text("Vx: "	+std::to_string(frame.rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
+		scene.text("Vy: "	+std::to_string(frame.rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
+
+		if(!frame.pass)
+		{
+			scene.text("RMSE Failed Threshold", 30, 150, 20, 1, 0, 0, "rmse_fail");
+			if(frame.rmseFailLog[0] > 0)
+				scene.text(" X: "+std::to_string(frame.rmseFailLog[0]), 30, 125, 20, 1, 0, 0, "rmse_fail_x");
+			if(frame.rmseFailLog[1] > 0)
+				scene.text(" Y: "+std::to_string(frame.rmseFailLog[1]), 30, 100, 20, 1, 0, 0, "rmse_fail_y");
+			if(frame.rmseFailLog[2] > 0)
+				scene.text("Vx: "+std::to_string(frame.rmseFailLog[2]), 30, 75, 20, 1, 0, 0, "rmse_fail_vx");
+			if(frame.rmseFailLog[3] > 0)
+				scene.text("Vy: "+std::to_string(frame.rmseFailLog[3]), 30, 50, 20, 1, 0, 0, "rmse_fail_vy");
+		}
+	}
+
+	// simulate and render one frame on the calling thread
+	void stepHighway(double egoVelocity, long long timestamp, int frame_per_sec, pcl::visualization::PCLVisualizer::Ptr& viewer)
+	{
+		TRACE_SCOPE("Highway::stepHighway");
+		simulate(egoVelocity, timestamp, frame_per_sec, serialFrame);
+		ScopedLatency latency(metrics.stage("render"));
+		render(serialFrame);
 	}
 	
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef KINEMATICS_H_
+#define KINEMATICS_H_
+
+#include <cmath>
+#include <vector>
+
+/**
+ * Kinematic state of all simulated cars as a structure of arrays. Each
+ * field is contiguous, so step() is a branch free loop over plain arrays
+ * that the compiler vectorizes, and cars can be stepped in bulk without
+ * touching their render data, filters or instructions.
+ */
+class KinematicsWorld
+{
+public:
+	// position in meters, double like Vect3
+	std::vector<double> x, y;
+	std::vector<float> velocity;
+	// heading and its cosine and sine, kept up to date by step()
+	std::vector<float> angle, cosAngle, sinAngle;
+	// current actuation
+	std::vector<float> acceleration, steering;
+	// distance between front of vehicle and center of gravity
+	std::vector<float> Lf;
+
+	size_t size() const { return x.size(); }
+
+	// append a car and return its index
+	int add(double setX, double setY, float setVelocity, float setAngle, float setLf)
+	{
+		x.push_back(setX);
+		y.push_back(setY);
+		velocity.push_back(setVelocity);
+		angle.push_back(setAngle);
+		cosAngle.push_back(std::cos(setAngle));
+		sinAngle.push_back(std::sin(setAngle));
+		acceleration.push_back(0);
+		steering.push_back(0);
+		Lf.push_back(setLf);
+		return (int)x.size() - 1;
+	}
+
+	void setActuation(int i, float setAcceleration, float setSteering)
+	{
+		acceleration[i] = setAcceleration;
+		steering[i] = setSteering;
+	}
+
+	/**
+	 * Advance every car by dt with the same bicycle model as Car::move.
+	 * The heading's cosine and sine are rotated by the heading change
+	 * instead of being recomputed, which keeps the loop free of calls.
+	 */
+	void step(float dt)
+	{
+		stepKernel((int)size(), x.data(), y.data(), velocity.data(), angle.data(), cosAngle.data(), sinAngle.data(),
+			acceleration.data(), steering.data(), Lf.data(), dt);
+	}
+
+private:
+	// restrict is only honored on parameters, so the loop lives in its own function
+	static void stepKernel(int n, double* __restrict px, double* __restrict py, float* __restrict pv,
+		float* __restrict pa, float* __restrict pc, float* __restrict ps,
+		const float* __restrict pacc, const float* __restrict psteer, const float* __restrict pLf, float dt)
+	{
+		for(int i = 0; i < n; i++)
+		{
+			float v = pv[i];
+			px[i] += v * pc[i] * dt;
+			py[i] += v * ps[i] * dt;
+
+			float dtheta = v * psteer[i] * dt / pLf[i];
+			pa[i] += dtheta;
+
+			// sin and cos of dtheta by their series, exact in float for the
+			// heading changes of one frame
+			float d2 = dtheta * dtheta;
+			float sd = dtheta * (1 - d2 / 6 * (1 - d2 / 20 * (1 - d2 / 42)));
+			float cd = 1 - d2 / 2 * (1 - d2 / 12 * (1 - d2 / 30));
+			float c = pc[i] * cd - ps[i] * sd;
+			float s = ps[i] * cd + pc[i] * sd;
+			// one Newton step back to unit length so rounding can't accumulate
+			float r = 1.5f - 0.5f * (c * c + s * s);
+			pc[i] = c * r;
+			ps[i] = s * r;
+
+			pv[i] += pacc[i] * dt;
+		}
+	}
+};
+
+#endif /* KINEMATICS_H_ */
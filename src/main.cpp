@@ -4,9 +4,53 @@
 
 //#include "render/render.h"
 #include "highway.h"
+#include "triple_buffer.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+void dumpMetrics(const Metrics& metrics, const std::string& file, const std::string& socketPath)
+{
+	bool csv = file.size() > 4 && file.compare(file.size()-4, 4, ".csv") == 0;
+	if(!file.empty() && !(csv ? metrics.writeCsv(file) : metrics.writePrometheus(file)))
+		std::cerr << "Couldn't write metrics to " << file << std::endl;
+	if(!socketPath.empty() && !metrics.sendPrometheus(socketPath))
+		std::cerr << "Couldn't send metrics to " << socketPath << std::endl;
+}
 
 int main(int argc, char** argv)
 {
+	// optional: --trace <file> records a frame by frame timeline in Chrome trace format
+	//           --metrics <file> dumps NIS, latency and allocation metrics every second,
+	//                            as CSV for *.csv files and Prometheus text otherwise
+	//           --metrics-socket <path> sends the Prometheus text to a unix domain socket
+	//           --scenario <file> replaces the three car scene with a file written by ukf_scenario
+	//           --serial simulates and renders on one thread
+	std::string traceFile, metricsFile, metricsSocket, scenarioFile;
+	bool serial = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(std::string(argv[i]) == "--serial")
+			serial = true;
+		else if(i+1 == argc)
+			break;
+		else if(std::string(argv[i]) == "--trace")
+			traceFile = argv[i+1];
+		else if(std::string(argv[i]) == "--metrics")
+			metricsFile = argv[i+1];
+		else if(std::string(argv[i]) == "--metrics-socket")
+			metricsSocket = argv[i+1];
+		else if(std::string(argv[i]) == "--scenario")
+			scenarioFile = argv[i+1];
+	}
+	traceEnable(!traceFile.empty());
+
+	Scenario scenario;
+	if(!scenarioFile.empty() && !scenario.load(scenarioFile))
+	{
+		std::cerr << "Couldn't load scenario " << scenarioFile << std::endl;
+		return 1;
+	}
 
 	pcl::visualization::PCLVisualizer::Ptr viewer(new pcl::visualization::PCLVisualizer("3D Viewer"));
 	viewer->setBackgroundColor(0, 0, 0);
@@ -16,7 +60,7 @@ int main(int argc, char** argv)
 	float x_pos = 0;
 	viewer->setCameraPosition ( x_pos-26, 0, 15.0, x_pos+25, 0, 0, 0, 0, 1);
 
-	Highway highway(viewer);
+	Highway highway = scenarioFile.empty() ? Highway(viewer) : Highway(viewer, scenario);
 
 	//initHighway(viewer);
 
@@ -27,17 +71,67 @@ int main(int argc, char** argv)
 
 	double egoVelocity = 25;
 
-	while (frame_count < (frame_per_sec*sec_interval))
+	// the lidar and radar debug markers draw into the viewer while sensing,
+	// so they need simulation and rendering on the same thread
+	if(serial || highway.visualize_lidar || highway.visualize_radar)
 	{
-		viewer->removeAllPointClouds();
-		viewer->removeAllShapes();
-
-		//stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
-		highway.stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
-		viewer->spinOnce(1000/frame_per_sec);
-		frame_count++;
-		time_us = 1000000*frame_count/frame_per_sec;
-		
+		while (frame_count < (frame_per_sec*sec_interval))
+		{
+			// shapes are retained by the highway scene, only clouds are rebuilt
+			viewer->removeAllPointClouds();
+
+			//stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
+			highway.stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
+			{
+				TRACE_SCOPE("viewer::spinOnce");
+				viewer->spinOnce(1000/frame_per_sec);
+			}
+			frame_count++;
+			time_us = 1000000*frame_count/frame_per_sec;
+
+			if(frame_count % frame_per_sec == 0)
+				dumpMetrics(highway.metrics, metricsFile, metricsSocket);
+		}
+	}
+	else
+	{
+		// simulation runs in real time on its own thread and never waits for
+		// the viewer, which shows the newest snapshot and skips stale ones
+		TripleBuffer<FrameSnapshot> frames;
+		std::atomic<bool> done(false);
+		std::thread simulation([&]()
+		{
+			auto next = std::chrono::steady_clock::now();
+			while (frame_count < (frame_per_sec*sec_interval))
+			{
+				highway.simulate(egoVelocity, time_us, frame_per_sec, frames.back());
+				frames.publish();
+				frame_count++;
+				time_us = 1000000*frame_count/frame_per_sec;
+
+				if(frame_count % frame_per_sec == 0)
+					dumpMetrics(highway.metrics, metricsFile, metricsSocket);
+				next += std::chrono::microseconds(1000000/frame_per_sec);
+				std::this_thread::sleep_until(next);
+			}
+			done.store(true, std::memory_order_release);
+		});
+
+		while (!done.load(std::memory_order_acquire))
+		{
+			if(frames.consume())
+			{
+				viewer->removeAllPointClouds();
+				highway.render(frames.front());
+			}
+			TRACE_SCOPE("viewer::spinOnce");
+			viewer->spinOnce(1000/frame_per_sec);
+		}
+		simulation.join();
+		if(frames.consume())
+			highway.render(frames.front());
 	}
 
+	if(!traceFile.empty() && !traceWriteChrome(traceFile))
+		std::cerr << "Couldn't write trace to " << traceFile << std::endl;
 }
\ No newline at end of file
@@ -14,6 +14,15 @@ public:
 
   Eigen::VectorXd raw_measurements_;
 
+  // position and velocity of the sensor in the frame the filter tracks in,
+  // all zero when the sensor sits still at the origin of that frame
+  double sensor_x_, sensor_y_;
+  double sensor_vx_, sensor_vy_;
+
+  MeasurementPackage()
+    : sensor_x_(0), sensor_y_(0), sensor_vx_(0), sensor_vy_(0)
+  {}
+
 };
 
 #endif /* MEASUREMENT_PACKAGE_H_ */
\ No newline at end of file
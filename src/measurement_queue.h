@@ -0,0 +1,195 @@
+#ifndef MEASUREMENT_QUEUE_H_
+#define MEASUREMENT_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "measurement_package.h"
+#include "mpsc_queue.h"
+
+/**
+ * MeasurementPackage without the heap allocated Eigen vector, so it can be
+ * copied through a lock-free queue. Holds up to three values.
+ */
+struct Measurement
+{
+	long long timestamp;
+	// track the measurement belongs to, as assigned by the driver or detector
+	int32_t track;
+	uint8_t sensor;
+	uint8_t size;
+	double values[3];
+	double sensorX, sensorY, sensorVx, sensorVy;
+
+	static Measurement fromPackage(const MeasurementPackage& package, int track)
+	{
+		Measurement measurement;
+		measurement.timestamp = package.timestamp_;
+		measurement.track = track;
+		measurement.sensor = (uint8_t)package.sensor_type_;
+		measurement.size = (uint8_t)std::min<long>(package.raw_measurements_.size(), 3);
+		for(int i = 0; i < 3; i++)
+			measurement.values[i] = i < measurement.size ? package.raw_measurements_(i) : 0;
+		measurement.sensorX = package.sensor_x_;
+		measurement.sensorY = package.sensor_y_;
+		measurement.sensorVx = package.sensor_vx_;
+		measurement.sensorVy = package.sensor_vy_;
+		return measurement;
+	}
+
+	MeasurementPackage toPackage() const
+	{
+		MeasurementPackage package;
+		package.timestamp_ = timestamp;
+		package.sensor_type_ = (MeasurementPackage::SensorType)sensor;
+		package.raw_measurements_ = Eigen::VectorXd(size);
+		for(int i = 0; i < size; i++)
+			package.raw_measurements_(i) = values[i];
+		package.sensor_x_ = sensorX;
+		package.sensor_y_ = sensorY;
+		package.sensor_vx_ = sensorVx;
+		package.sensor_vy_ = sensorVy;
+		return package;
+	}
+};
+
+// counters of MeasurementIngest, readable from any thread
+struct IngestStats
+{
+	// accepted by submit
+	std::atomic<long long> submitted;
+	// refused by submit because the queue was full, the producer's backpressure signal
+	std::atomic<long long> rejected;
+	// arrived after measurements with later timestamps had been dispatched
+	std::atomic<long long> late;
+	// dispatched before their window passed because the reorder window was full
+	std::atomic<long long> forced;
+	std::atomic<long long> dispatched;
+	// deepest the queue and the reorder window have been
+	std::atomic<long long> maxQueueDepth;
+	std::atomic<long long> maxReorderDepth;
+
+	IngestStats()
+		: submitted(0), rejected(0), late(0), forced(0), dispatched(0), maxQueueDepth(0), maxReorderDepth(0)
+	{}
+};
+
+/**
+ * Entry point for sensor drivers on their own threads. Producers submit()
+ * into a bounded lock-free queue; the consumer drains it into a reorder
+ * window, a min-heap on timestamp, and releases measurements in time order
+ * once they are older than the window. A measurement that shows up after
+ * later ones were released would make a filter predict backwards, so it is
+ * dropped and counted instead. The window holds at most reorderCapacity
+ * measurements; past that the earliest is released early and counted, so
+ * a producer that stalls cannot make the consumer hoard everything the
+ * others send. Released batches are sorted by time, as
+ * TrackerRuntime::process takes them; which worker owns a track is left to
+ * the runtime, so there is a single ownership rule.
+ */
+class MeasurementIngest
+{
+public:
+
+	MeasurementIngest(size_t capacity, long long setWindow_us, size_t setReorderCapacity = 1 << 16)
+		: window_us(setWindow_us), reorderCapacity(std::max<size_t>(1, setReorderCapacity)), queue(capacity), released(-1), sequence(0)
+	{}
+
+	/**
+	 * Any thread, never blocks
+	 * @return false if the queue is full and the measurement was not taken
+	 */
+	bool submit(const Measurement& measurement)
+	{
+		if(!queue.tryPush(measurement))
+		{
+			stats.rejected++;
+			return false;
+		}
+		stats.submitted++;
+		return true;
+	}
+
+	/**
+	 * Consumer thread: take everything queued and release the measurements
+	 * with timestamp <= now - window in time order, appended to batch
+	 * @return Number of measurements released
+	 */
+	int drain(long long now, std::vector<Measurement>& batch)
+	{
+		updateMax(stats.maxQueueDepth, queue.depth());
+		int forced = 0;
+		Entry entry;
+		while(queue.tryPop(entry.measurement))
+		{
+			if(entry.measurement.timestamp < released)
+			{
+				stats.late++;
+				continue;
+			}
+			entry.sequence = sequence++;
+			heap.push_back(entry);
+			std::push_heap(heap.begin(), heap.end(), later);
+			if(heap.size() > reorderCapacity)
+			{
+				release(batch);
+				forced++;
+			}
+		}
+		updateMax(stats.maxReorderDepth, heap.size());
+
+		int count = forced;
+		while(!heap.empty() && heap.front().measurement.timestamp <= now - window_us)
+		{
+			release(batch);
+			count++;
+		}
+		stats.forced += forced;
+		stats.dispatched += count;
+		return count;
+	}
+
+	IngestStats stats;
+	// how long a measurement waits for earlier ones that are still in flight
+	const long long window_us;
+	// most measurements the reorder window holds
+	const size_t reorderCapacity;
+
+private:
+	struct Entry
+	{
+		Measurement measurement;
+		// arrival order, keeps equal timestamps in the order they came in
+		long long sequence;
+	};
+
+	// heap comparator, puts the earliest measurement on top
+	static bool later(const Entry& a, const Entry& b)
+	{
+		return a.measurement.timestamp != b.measurement.timestamp ? a.measurement.timestamp > b.measurement.timestamp : a.sequence > b.sequence;
+	}
+
+	// move the earliest measurement of the window to the batch
+	void release(std::vector<Measurement>& batch)
+	{
+		released = heap.front().measurement.timestamp;
+		batch.push_back(heap.front().measurement);
+		std::pop_heap(heap.begin(), heap.end(), later);
+		heap.pop_back();
+	}
+
+	static void updateMax(std::atomic<long long>& max, long long value)
+	{
+		if(value > max.load(std::memory_order_relaxed))
+			max.store(value, std::memory_order_relaxed);
+	}
+
+	MpscQueue<Measurement> queue;
+	std::vector<Entry> heap;
+	// timestamp of the last released measurement
+	long long released;
+	long long sequence;
+};
+
+#endif /* MEASUREMENT_QUEUE_H_ */
@@ -0,0 +1,248 @@
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Count every heap allocation by replacing the global allocation
+// functions; the cost is one relaxed atomic increment for the process and
+// one plain increment for the calling thread.
+namespace {
+std::atomic<long long> allocations(0);
+// constant initialized, so safe to touch from operator new
+thread_local long long threadAllocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	threadAllocations++;
+	if(void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+long long allocationCount()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+long long threadAllocationCount()
+{
+	return threadAllocations;
+}
+
+LogHistogram::LogHistogram()
+	: count(0), sum(0), max(0), buckets(kBuckets, 0)
+{}
+
+int LogHistogram::bucketIndex(long long value)
+{
+	if(value < kSubBuckets)
+		return value < 0 ? 0 : (int)value;
+	int exponent = 63 - __builtin_clzll((unsigned long long)value);
+	int sub = (int)(value >> (exponent - kSubBits)) & (kSubBuckets - 1);
+	return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+long long LogHistogram::bucketUpper(int index)
+{
+	if(index < kSubBuckets)
+		return index;
+	int exponent = index / kSubBuckets + kSubBits - 1;
+	int sub = index % kSubBuckets;
+	long long lower = (long long)(kSubBuckets + sub) << (exponent - kSubBits);
+	return lower + ((1LL << (exponent - kSubBits)) - 1);
+}
+
+void LogHistogram::record(long long value)
+{
+	buckets[bucketIndex(value)]++;
+	count++;
+	sum += value;
+	if(value > max)
+		max = value;
+}
+
+long long LogHistogram::percentile(double q) const
+{
+	long long target = (long long)(q * count + 0.5);
+	long long seen = 0;
+	for(int i = 0; i < kBuckets; i++)
+	{
+		seen += buckets[i];
+		if(seen >= target && seen > 0)
+			return std::min(bucketUpper(i), max);
+	}
+	return max;
+}
+
+long long LogHistogram::countBelow(long long value) const
+{
+	long long n = 0;
+	for(int i = 0; i < kBuckets && bucketUpper(i) <= value; i++)
+		n += buckets[i];
+	return n;
+}
+
+Metrics::Metrics()
+	: frames(0), frameStartAllocations(0)
+{
+	nis["lidar"] = NisMonitor(kLidarNisBound);
+	nis["radar"] = NisMonitor(kRadarNisBound);
+}
+
+void Metrics::recordNis(MeasurementPackage::SensorType sensor, double value)
+{
+	nis[sensor == MeasurementPackage::LASER ? "lidar" : "radar"].record(value);
+}
+
+LogHistogram& Metrics::stage(const std::string& name)
+{
+	return stages[name];
+}
+
+void Metrics::beginFrame()
+{
+	frameStartAllocations = threadAllocationCount();
+}
+
+void Metrics::endFrame()
+{
+	frameAllocations.record(threadAllocationCount() - frameStartAllocations);
+	frames++;
+}
+
+std::string Metrics::prometheus() const
+{
+	std::ostringstream out;
+
+	out << "# HELP ukf_nis_samples_total NIS samples per sensor\n";
+	out << "# TYPE ukf_nis_samples_total counter\n";
+	for(auto& it : nis)
+		out << "ukf_nis_samples_total{sensor=\"" << it.first << "\"} " << it.second.count << "\n";
+	out << "# HELP ukf_nis_consistent_ratio Fraction of NIS samples below the chi-square 95% bound\n";
+	out << "# TYPE ukf_nis_consistent_ratio gauge\n";
+	for(auto& it : nis)
+		out << "ukf_nis_consistent_ratio{sensor=\"" << it.first << "\"} " << it.second.consistentRatio() << "\n";
+	out << "# HELP ukf_nis_mean Mean NIS, ideally the measurement dimension\n";
+	out << "# TYPE ukf_nis_mean gauge\n";
+	for(auto& it : nis)
+		out << "ukf_nis_mean{sensor=\"" << it.first << "\"} " << (it.second.count ? it.second.sum / it.second.count : 0) << "\n";
+
+	out << "# HELP ukf_stage_latency_seconds Latency of the simulation, sensing, filtering and rendering stages\n";
+	out << "# TYPE ukf_stage_latency_seconds histogram\n";
+	for(auto& it : stages)
+	{
+		const LogHistogram& h = it.second;
+		// power of two bounds from ~1us to ~17s, exact bucket edges of LogHistogram
+		for(int k = 10; k <= 34; k++)
+		{
+			long long bound = (1LL << k) - 1;
+			out << "ukf_stage_latency_seconds_bucket{stage=\"" << it.first << "\",le=\"" << bound * 1e-9 << "\"} " << h.countBelow(bound) << "\n";
+		}
+		out << "ukf_stage_latency_seconds_bucket{stage=\"" << it.first << "\",le=\"+Inf\"} " << h.count << "\n";
+		out << "ukf_stage_latency_seconds_sum{stage=\"" << it.first << "\"} " << h.sum * 1e-9 << "\n";
+		out << "ukf_stage_latency_seconds_count{stage=\"" << it.first << "\"} " << h.count << "\n";
+	}
+
+	out << "# HELP ukf_frame_allocations Heap allocations per frame by the simulation thread\n";
+	out << "# TYPE ukf_frame_allocations summary\n";
+	const double quantiles[] = {0.5, 0.9, 0.99};
+	for(double q : quantiles)
+		out << "ukf_frame_allocations{quantile=\"" << q << "\"} " << frameAllocations.percentile(q) << "\n";
+	out << "ukf_frame_allocations_sum " << frameAllocations.sum << "\n";
+	out << "ukf_frame_allocations_count " << frameAllocations.count << "\n";
+
+	out << "# HELP ukf_frames_total Simulated frames\n";
+	out << "# TYPE ukf_frames_total counter\n";
+	out << "ukf_frames_total " << frames << "\n";
+	return out.str();
+}
+
+bool Metrics::writePrometheus(const std::string& file) const
+{
+	// write then rename so scrapers never see a partial file
+	std::string tmp = file + ".tmp";
+	{
+		std::ofstream out(tmp.c_str());
+		if(!(out << prometheus()))
+			return false;
+	}
+	return std::rename(tmp.c_str(), file.c_str()) == 0;
+}
+
+bool Metrics::sendPrometheus(const std::string& socketPath) const
+{
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(socketPath.size() >= sizeof(addr.sun_path))
+		return false;
+	std::strcpy(addr.sun_path, socketPath.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+		return false;
+	bool ok = connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+	std::string text = prometheus();
+	for(size_t sent = 0; ok && sent < text.size(); )
+	{
+		// a reader that hung up must not raise SIGPIPE and take the process down
+		ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+		ok = n > 0;
+		sent += ok ? n : 0;
+	}
+	close(fd);
+	return ok;
+}
+
+bool Metrics::writeCsv(const std::string& file) const
+{
+	std::ofstream out(file.c_str());
+	if(!out)
+		return false;
+	out << "metric,label,statistic,value\n";
+	for(auto& it : nis)
+	{
+		out << "nis," << it.first << ",count," << it.second.count << "\n";
+		out << "nis," << it.first << ",consistent_ratio," << it.second.consistentRatio() << "\n";
+		out << "nis," << it.first << ",mean," << (it.second.count ? it.second.sum / it.second.count : 0) << "\n";
+	}
+	const double quantiles[] = {0.5, 0.9, 0.99};
+	for(auto& it : stages)
+	{
+		out << "latency_ns," << it.first << ",count," << it.second.count << "\n";
+		out << "latency_ns," << it.first << ",mean," << (it.second.count ? it.second.sum / it.second.count : 0) << "\n";
+		for(double q : quantiles)
+			out << "latency_ns," << it.first << ",p" << (int)(q * 100) << "," << it.second.percentile(q) << "\n";
+		out << "latency_ns," << it.first << ",max," << it.second.max << "\n";
+	}
+	for(double q : quantiles)
+		out << "frame_allocations,," << "p" << (int)(q * 100) << "," << frameAllocations.percentile(q) << "\n";
+	out << "frame_allocations,,max," << frameAllocations.max << "\n";
+	out << "frames,,count," << frames << "\n";
+	return (bool)out;
+}
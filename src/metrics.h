@@ -0,0 +1,137 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "measurement_package.h"
+#include "trace.h"
+
+/**
+ * Log-linear histogram in the spirit of HdrHistogram: every power of two
+ * is split into kSubBuckets linear buckets, giving a bounded relative
+ * error of 1/kSubBuckets over the whole range at constant record cost.
+ */
+class LogHistogram
+{
+public:
+	static const int kSubBits = 5;
+	static const int kSubBuckets = 1 << kSubBits;
+	static const int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+	LogHistogram();
+
+	void record(long long value);
+
+	// smallest bucket upper bound that covers fraction q of the samples
+	long long percentile(double q) const;
+
+	// number of samples <= value, exact at bucket upper bounds
+	long long countBelow(long long value) const;
+
+	long long count;
+	long long sum;
+	long long max;
+
+private:
+	static int bucketIndex(long long value);
+	static long long bucketUpper(int index);
+
+	std::vector<long long> buckets;
+};
+
+/**
+ * Normalized innovation squared of one sensor. A consistent filter keeps
+ * about 95% of the samples below the chi-square 95% bound of the
+ * measurement dimension.
+ */
+struct NisMonitor
+{
+	long long count;
+	long long consistent;
+	double sum;
+	double threshold;
+
+	NisMonitor(double setThreshold = 0)
+		: count(0), consistent(0), sum(0), threshold(setThreshold)
+	{}
+
+	void record(double nis)
+	{
+		count++;
+		sum += nis;
+		if(nis <= threshold)
+			consistent++;
+	}
+
+	void merge(const NisMonitor& other)
+	{
+		count += other.count;
+		consistent += other.consistent;
+		sum += other.sum;
+	}
+
+	double consistentRatio() const { return count ? (double)consistent / count : 0; }
+};
+
+// chi-square 95% bounds for 2 (lidar) and 3 (radar) degrees of freedom
+const double kLidarNisBound = 5.991;
+const double kRadarNisBound = 7.815;
+
+// heap allocations made by the whole process so far
+long long allocationCount();
+// heap allocations made by the calling thread so far
+long long threadAllocationCount();
+
+class Metrics
+{
+public:
+	Metrics();
+
+	// per sensor NIS with chi-square consistency
+	void recordNis(MeasurementPackage::SensorType sensor, double nis);
+
+	// latency histogram of a named stage, in nanoseconds
+	LogHistogram& stage(const std::string& name);
+
+	// per frame bookkeeping of the allocations of the calling thread, the
+	// simulation thread, so the viewer's rendering does not count
+	void beginFrame();
+	void endFrame();
+
+	// Prometheus text exposition format
+	std::string prometheus() const;
+	bool writePrometheus(const std::string& file) const;
+	// send the exposition text to a listening unix domain socket
+	bool sendPrometheus(const std::string& socketPath) const;
+
+	bool writeCsv(const std::string& file) const;
+
+	std::map<std::string, NisMonitor> nis;
+	std::map<std::string, LogHistogram> stages;
+	LogHistogram frameAllocations;
+	long long frames;
+
+private:
+	long long frameStartAllocations;
+};
+
+// records the lifetime of a scope into a stage histogram
+class ScopedLatency
+{
+public:
+	explicit ScopedLatency(LogHistogram& setHistogram)
+		: histogram(setHistogram), start(traceNow())
+	{}
+
+	~ScopedLatency()
+	{
+		histogram.record(traceNow() - start);
+	}
+
+private:
+	LogHistogram& histogram;
+	long long start;
+};
+
+#endif /* METRICS_H_ */
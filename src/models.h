@@ -0,0 +1,300 @@
+#ifndef MODELS_H
+#define MODELS_H
+
+#include "Eigen/Dense"
+#include <cmath>
+
+/**
+ * Process and measurement models used by the UKF.
+ *
+ * Models are plugged in through CRTP: a new model derives from
+ * ProcessModel<Derived> or MeasurementModel<Derived> and implements the
+ * *Impl hooks. The UKF only ever calls the base class front-ends, which
+ * resolve to the derived implementation at compile time, so a model costs
+ * no more than the hand-inlined equations it replaces.
+ *
+ * Measurement models that are linear in the state set kLinear and provide
+ * ObservationMatrix(); the UKF then skips the sigma point transform and
+ * applies the closed form Kalman update, which is exact for them.
+ * Models that can place a new track from one measurement implement
+ * InitializeImpl(); the others have to wait for one that can.
+ *
+ * Process models operate on the augmented state
+ *   [px py v yaw yawd nu_a nu_yawdd]
+ * and write the predicted state [px py v yaw yawd]. Models compute in the
+ * scalar type of the columns they are handed so the same model serves both
+ * the float and the double filter.
+ */
+
+// wrap an angle to [-pi, pi) in constant time, without branches, so that
+// corrupted inputs such as 1e6 rad cost the same as in-range ones; inf and
+// NaN come back as NaN so a diverged filter shows instead of pointing at 0
+template <typename Scalar>
+inline Scalar WrapAngle(Scalar val) {
+  const Scalar pi = Scalar(M_PI);
+  const Scalar two_pi = Scalar(2*M_PI);
+  Scalar wrapped = val - two_pi*std::floor((val + pi)/two_pi);
+  // rounding leaves the range by an ulp next to its ends, and by more for
+  // inputs so large that they have no digits below 2 pi left
+  wrapped = wrapped < -pi ? wrapped + two_pi : wrapped;
+  wrapped = wrapped >= pi ? wrapped - two_pi : wrapped;
+  // what is still outside is a finite input without digits below 2 pi left,
+  // which carries no angle, or inf or NaN; val - val tells them apart
+  return wrapped >= -pi && wrapped < pi ? wrapped : val - val;
+}
+
+template <typename Scalar>
+inline void NormalizeAngle(Scalar& val) {
+  val = WrapAngle(val);
+}
+
+// wrap every coefficient of a block, e.g. the yaw row of all sigma points;
+// the loop has no data dependent branches and vectorizes
+template <typename Derived>
+inline void NormalizeAngles(const Eigen::MatrixBase<Derived>& angles_) {
+  Eigen::MatrixBase<Derived>& angles = const_cast<Eigen::MatrixBase<Derived>&>(angles_);
+  for (int j = 0; j < angles.cols(); ++j) {
+    for (int i = 0; i < angles.rows(); ++i) {
+      angles(i,j) = WrapAngle(angles(i,j));
+    }
+  }
+}
+
+// a sensor carried by a moving car sees traffic that drives along with it,
+// within a few m/s of its speed and a few degrees of its heading, a far
+// better start for a new track than standing still in any direction; a
+// sensor that stands still leaves v, yaw and yaw rate at the filter's prior
+template <typename StateVec, typename StateMat>
+inline void InitializeFromCarrier(double sensor_vx, double sensor_vy, StateVec& x, StateMat& P) {
+  if (sensor_vx != 0 || sensor_vy != 0) {
+    x(2) = std::sqrt(sensor_vx*sensor_vx + sensor_vy*sensor_vy);
+    x(3) = std::atan2(sensor_vy, sensor_vx);
+    P(2,2) = 2.0*2.0;
+    P(3,3) = 0.05*0.05;
+    P(4,4) = 0.1*0.1;
+  }
+}
+
+template <typename Derived>
+struct ProcessModel {
+  /**
+   * Predict one augmented sigma point forward in time
+   * @param x_aug Augmented sigma point at k
+   * @param delta_t Time between k and k+1 in s
+   * @param x_out Predicted sigma point at k+1
+   */
+  template <typename AugCol, typename StateCol>
+  void Predict(const AugCol& x_aug, double delta_t, StateCol x_out) const {
+    static_cast<const Derived*>(this)->PredictImpl(x_aug, delta_t, x_out);
+  }
+
+  /**
+   * Predict all augmented sigma points forward in time, letting the model
+   * hoist terms that only depend on delta_t out of the per point work
+   * @param Xsig_aug Augmented sigma points at k, one per column
+   * @param delta_t Time between k and k+1 in s
+   * @param Xsig_pred Predicted sigma points at k+1
+   */
+  template <typename AugMat, typename StateMat>
+  void PredictAll(const AugMat& Xsig_aug, double delta_t, StateMat& Xsig_pred) const {
+    static_cast<const Derived*>(this)->PredictAllImpl(Xsig_aug, delta_t, Xsig_pred);
+  }
+
+  template <typename AugMat, typename StateMat>
+  void PredictAllImpl(const AugMat& Xsig_aug, double delta_t, StateMat& Xsig_pred) const {
+    for (int i = 0; i < Xsig_aug.cols(); ++i) {
+      Predict(Xsig_aug.col(i), delta_t, Xsig_pred.col(i));
+    }
+  }
+};
+
+template <typename Derived>
+struct MeasurementModel {
+  // nonlinear unless the model says otherwise
+  enum { kLinear = 0 };
+
+  /**
+   * Transform one predicted sigma point into measurement space
+   * @param x Predicted sigma point
+   * @param z_out Sigma point in measurement space
+   */
+  template <typename StateCol, typename MeasCol>
+  void Measure(const StateCol& x, MeasCol z_out) const {
+    static_cast<const Derived*>(this)->MeasureImpl(x, z_out);
+  }
+
+  /**
+   * Bring measurement residuals back into range, e.g. wrap angles
+   * @param z_diff Residual, or matrix of residual columns, in measurement space
+   */
+  template <typename MeasVec>
+  void Normalize(MeasVec& z_diff) const {
+    static_cast<const Derived*>(this)->NormalizeImpl(z_diff);
+  }
+
+  /**
+   * Measurement noise covariance, fixed size so no update allocates it
+   */
+  template <typename D = Derived>
+  Eigen::Matrix<double, D::kSize, D::kSize> NoiseCovariance() const {
+    return static_cast<const D*>(this)->NoiseCovarianceImpl();
+  }
+
+  /**
+   * Place a new track at its first measurement
+   * @param z First measurement of the track
+   * @param x State to initialize, models write the entries they observe
+   * @param P State covariance holding the filter's prior, models may
+   * tighten the entries they know more about
+   * @return false if the sensor cannot place a track on its own
+   */
+  template <typename MeasVec, typename StateVec, typename StateMat>
+  bool Initialize(const MeasVec& z, StateVec& x, StateMat& P) const {
+    return static_cast<const Derived*>(this)->InitializeImpl(z, x, P);
+  }
+
+  // residuals need no wrapping unless the model says otherwise
+  template <typename MeasVec>
+  void NormalizeImpl(MeasVec&) const {}
+
+  // bearing or range rate only sensors cannot start a track
+  template <typename MeasVec, typename StateVec, typename StateMat>
+  bool InitializeImpl(const MeasVec&, StateVec&, StateMat&) const { return false; }
+};
+
+// Constant turn rate and velocity magnitude model
+struct CtrvModel : ProcessModel<CtrvModel> {
+  template <typename AugCol, typename StateCol>
+  void PredictImpl(const AugCol& x_aug, double dt, StateCol x_out) const {
+    typedef typename AugCol::Scalar Scalar;
+    PredictPoint(x_aug, Scalar(dt), Scalar(0.5*dt*dt), x_out);
+  }
+
+  template <typename AugMat, typename StateMat>
+  void PredictAllImpl(const AugMat& Xsig_aug, double dt, StateMat& Xsig_pred) const {
+    typedef typename AugMat::Scalar Scalar;
+    // step constants shared by every sigma point
+    Scalar delta_t  = dt;
+    Scalar half_dt2 = 0.5*dt*dt;
+    for (int i = 0; i < Xsig_aug.cols(); ++i) {
+      PredictPoint(Xsig_aug.col(i), delta_t, half_dt2, Xsig_pred.col(i));
+    }
+  }
+
+  template <typename AugCol, typename Scalar, typename StateCol>
+  static void PredictPoint(const AugCol& x_aug, Scalar delta_t, Scalar half_dt2, StateCol x_out) {
+    Scalar p_x      = x_aug(0);
+    Scalar p_y      = x_aug(1);
+    Scalar v        = x_aug(2);
+    Scalar yaw      = x_aug(3);
+    Scalar yawd     = x_aug(4);
+    Scalar nu_a     = x_aug(5);
+    Scalar nu_yawdd = x_aug(6);
+    Scalar cos_yaw  = std::cos(yaw);
+    Scalar sin_yaw  = std::sin(yaw);
+    Scalar px_p, py_p;
+    if (std::fabs(yawd) > 0.001) {
+        px_p = p_x + v/yawd * ( std::sin(yaw + yawd*delta_t) - sin_yaw);
+        py_p = p_y + v/yawd * ( cos_yaw - std::cos(yaw + yawd*delta_t) );
+    } else {
+        px_p = p_x + v*delta_t*cos_yaw;
+        py_p = p_y + v*delta_t*sin_yaw;
+    }
+    x_out(0) = px_p + nu_a*half_dt2 * cos_yaw;
+    x_out(1) = py_p + nu_a*half_dt2 * sin_yaw;
+    x_out(2) = v + nu_a*delta_t;
+    x_out(3) = yaw + yawd*delta_t + nu_yawdd*half_dt2;
+    x_out(4) = yawd + nu_yawdd*delta_t;
+  }
+};
+
+// Lidar: direct observation of [px py]; the sensor's velocity only seeds
+// new tracks
+struct LidarModel : MeasurementModel<LidarModel> {
+  enum { kSize = 2, kLinear = 1 };
+
+  double std_px, std_py;
+  double sensor_vx, sensor_vy;
+
+  LidarModel(double setStdPx, double setStdPy, double setSensorVx = 0, double setSensorVy = 0)
+    : std_px(setStdPx), std_py(setStdPy), sensor_vx(setSensorVx), sensor_vy(setSensorVy)
+  {}
+
+  template <typename StateCol, typename MeasCol>
+  void MeasureImpl(const StateCol& x, MeasCol z_out) const {
+    z_out(0) = x(0);
+    z_out(1) = x(1);
+  }
+
+  template <typename MeasVec, typename StateVec, typename StateMat>
+  bool InitializeImpl(const MeasVec& z, StateVec& x, StateMat& P) const {
+    x(0) = z(0);
+    x(1) = z(1);
+    InitializeFromCarrier(sensor_vx, sensor_vy, x, P);
+    return true;
+  }
+
+  // H = [I2 0]
+  Eigen::MatrixXd ObservationMatrix(int n_x) const {
+    return Eigen::MatrixXd::Identity(int(kSize), n_x);
+  }
+
+  Eigen::Matrix<double, kSize, kSize> NoiseCovarianceImpl() const {
+    Eigen::Matrix<double, kSize, kSize> R;
+    R <<  std_px*std_px, 0,
+          0, std_py*std_py;
+    return R;
+  }
+};
+
+// Radar: [rho phi rho_dot] relative to the sensor, at the origin unless
+// its position and velocity are given
+struct RadarModel : MeasurementModel<RadarModel> {
+  enum { kSize = 3 };
+
+  double std_r, std_phi, std_rd;
+  double sensor_x, sensor_y, sensor_vx, sensor_vy;
+
+  RadarModel(double setStdR, double setStdPhi, double setStdRd,
+             double setSensorX = 0, double setSensorY = 0, double setSensorVx = 0, double setSensorVy = 0)
+    : std_r(setStdR), std_phi(setStdPhi), std_rd(setStdRd),
+      sensor_x(setSensorX), sensor_y(setSensorY), sensor_vx(setSensorVx), sensor_vy(setSensorVy)
+  {}
+
+  template <typename StateCol, typename MeasCol>
+  void MeasureImpl(const StateCol& x, MeasCol z_out) const {
+    typedef typename StateCol::Scalar Scalar;
+    Scalar p_x    = x(0) - Scalar(sensor_x);
+    Scalar p_y    = x(1) - Scalar(sensor_y);
+    Scalar v      = x(2);
+    Scalar yaw    = x(3);
+    Scalar v1     = std::cos(yaw)*v - Scalar(sensor_vx);
+    Scalar v2     = std::sin(yaw)*v - Scalar(sensor_vy);
+    z_out(0) = std::sqrt(p_x*p_x + p_y*p_y);
+    z_out(1) = std::atan2(p_y,p_x);
+    z_out(2) = (p_x*v1 + p_y*v2) / std::sqrt(p_x*p_x + p_y*p_y);
+  }
+
+  template <typename MeasVec>
+  void NormalizeImpl(MeasVec& z_diff) const {
+    NormalizeAngles(z_diff.row(1));
+  }
+
+  template <typename MeasVec, typename StateVec, typename StateMat>
+  bool InitializeImpl(const MeasVec& z, StateVec& x, StateMat& P) const {
+    x(0) = sensor_x + z(0)*std::cos(z(1));
+    x(1) = sensor_y + z(0)*std::sin(z(1));
+    InitializeFromCarrier(sensor_vx, sensor_vy, x, P);
+    return true;
+  }
+
+  Eigen::Matrix<double, kSize, kSize> NoiseCovarianceImpl() const {
+    Eigen::Matrix<double, kSize, kSize> R;
+    R <<  std_r*std_r, 0, 0,
+          0, std_phi*std_phi, 0,
+          0, 0, std_rd*std_rd;
+    return R;
+  }
+};
+
+#endif  // MODELS_H
@@ -0,0 +1,217 @@
+#include "monte_carlo.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include "event_queue.h"
+#include "kinematics.h"
+
+namespace {
+
+struct RunStats
+{
+	double rmse[4];
+	bool passed;
+	NisMonitor lidarNis;
+	NisMonitor radarNis;
+	long long updates;
+	double filterSeconds;
+};
+
+// splitmix64 finalizer, spreads run seeds over the 32 bit seed space
+uint32_t seedMask(unsigned int seed)
+{
+	if(seed == 0)
+		return 0;
+	uint64_t z = seed * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (uint32_t)(z ^ (z >> 31));
+}
+
+// Tools::noise with the run's seed mask folded into the per sample seed
+double noise(double stddev, long long seedNum, uint32_t mask)
+{
+	std::mt19937 generator((uint32_t)seedNum ^ mask);
+	return std::normal_distribution<double>{0, stddev}(generator);
+}
+
+template <typename Filter>
+RunStats simulateRun(const Scenario& scenario, double std_a, double std_yawdd, unsigned int seed, const MonteCarloConfig& config)
+{
+	KinematicsWorld world;
+	ActuationQueue actuations;
+	actuations.reserve(scenario.events.size());
+	for(const ScenarioCar& car : scenario.cars)
+	{
+		int index = world.add(car.x, car.y, car.velocity, car.angle, 2);
+		for(uint32_t e = car.firstEvent; e < car.firstEvent + car.numEvents; e++)
+			actuations.push(scenario.events[e].time_us, index, scenario.events[e].acceleration, scenario.events[e].steering);
+	}
+
+	std::vector<Filter> filters(scenario.cars.size());
+	typename Filter::UnscentedTransform::Ptr simplex;
+	for(Filter& ukf : filters)
+	{
+		ukf.std_a_ = std_a;
+		ukf.std_yawdd_ = std_yawdd;
+		if(!config.simplexSigmaPoints)
+			continue;
+		if(!simplex)
+			simplex = Filter::UnscentedTransform::SphericalSimplex(ukf.n_aug_, config.simplexW0, 1, 0);
+		ukf.SetUnscentedTransform(simplex);
+	}
+
+	RunStats stats;
+	stats.passed = true;
+	stats.lidarNis = NisMonitor(kLidarNisBound);
+	stats.radarNis = NisMonitor(kRadarNisBound);
+	// only the filter calls are timed, noise generation dominates the run otherwise
+	std::chrono::steady_clock::duration filterTime(0);
+	const uint32_t mask = seedMask(seed);
+
+	// running sums of squared errors, the RMSE Highway recomputes every frame
+	double squared[4] = {0, 0, 0, 0};
+	long long samples = 0;
+
+	const int frames = (int)(config.duration_s * config.framesPerSec);
+	for(int frame = 0; frame < frames; frame++)
+	{
+		long long timestamp = 1000000LL * frame / config.framesPerSec;
+		actuations.applyDue(timestamp, world);
+		world.step((double)1/config.framesPerSec);
+
+		for(size_t i = 0; i < filters.size(); i++)
+		{
+			Filter& ukf = filters[i];
+			double x = world.x[i];
+			double y = world.y[i];
+			float v = world.velocity[i];
+			float angle = world.angle[i];
+
+			MeasurementPackage lidar;
+			lidar.sensor_type_ = MeasurementPackage::LASER;
+			lidar.raw_measurements_ = Eigen::VectorXd(2);
+			lidar.raw_measurements_ << x + noise(0.15, timestamp, mask), y + noise(0.15, timestamp+1, mask);
+			lidar.timestamp_ = timestamp;
+			long updates = ukf.health_.updates;
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			ukf.ProcessMeasurement(lidar);
+			filterTime += std::chrono::steady_clock::now() - begin;
+			if(ukf.health_.updates > updates)
+				stats.lidarNis.record(ukf.NIS_lidar);
+
+			// the ego car sits at the origin
+			double rho = sqrt(x*x + y*y);
+			double phi = atan2(y, x);
+			double rho_dot = (v*std::cos(angle)*rho*cos(phi) + v*std::sin(angle)*rho*sin(phi))/rho;
+			MeasurementPackage radar;
+			radar.sensor_type_ = MeasurementPackage::RADAR;
+			radar.raw_measurements_ = Eigen::VectorXd(3);
+			radar.raw_measurements_ << rho + noise(0.3, timestamp+2, mask), phi + noise(0.03, timestamp+3, mask), rho_dot + noise(0.3, timestamp+4, mask);
+			radar.timestamp_ = timestamp;
+			updates = ukf.health_.updates;
+			begin = std::chrono::steady_clock::now();
+			ukf.ProcessMeasurement(radar);
+			filterTime += std::chrono::steady_clock::now() - begin;
+			if(ukf.health_.updates > updates)
+				stats.radarNis.record(ukf.NIS_radar);
+
+			double error[4] = {
+				ukf.x_(0) - x,
+				ukf.x_(1) - y,
+				ukf.x_(2)*cos(ukf.x_(3)) - v*std::cos(angle),
+				ukf.x_(2)*sin(ukf.x_(3)) - v*std::sin(angle)};
+			for(int k = 0; k < 4; k++)
+				squared[k] += error[k]*error[k];
+			samples++;
+		}
+
+		for(int k = 0; k < 4; k++)
+		{
+			stats.rmse[k] = samples ? sqrt(squared[k]/samples) : 0;
+			if(timestamp > 1.0e6 && stats.rmse[k] > config.rmseThreshold[k])
+				stats.passed = false;
+		}
+	}
+
+	stats.updates = 0;
+	for(const Filter& ukf : filters)
+		stats.updates += ukf.health_.updates;
+	stats.filterSeconds = std::chrono::duration<double>(filterTime).count();
+	return stats;
+}
+
+}
+
+std::vector<MonteCarloResult> runMonteCarlo(const MonteCarloConfig& config)
+{
+	struct GridPoint { double std_a, std_yawdd; };
+	std::vector<GridPoint> grid;
+	for(double a : config.stdA)
+		for(double yawdd : config.stdYawdd)
+			grid.push_back(GridPoint{a, yawdd});
+
+	const int jobs = (int)grid.size() * config.runs;
+	std::vector<RunStats> stats(jobs);
+	std::atomic<int> next(0);
+
+	// runs are independent, workers just pull the next job index
+	auto worker = [&]()
+	{
+		for(int job = next++; job < jobs; job = next++)
+		{
+			const GridPoint& point = grid[job / config.runs];
+			unsigned int seed = config.firstSeed + job % config.runs;
+			Scenario generated;
+			if(config.numCars > 0)
+				generated = Scenario::generate(config.numCars, seed);
+			const Scenario& scenario = config.numCars > 0 ? generated : config.scenario;
+			if(config.singlePrecision)
+				stats[job] = simulateRun<UKFT<float> >(scenario, point.std_a, point.std_yawdd, seed, config);
+			else
+				stats[job] = simulateRun<UKFT<double> >(scenario, point.std_a, point.std_yawdd, seed, config);
+		}
+	};
+
+	int numThreads = config.threads > 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for(int t = 0; t < numThreads; t++)
+		threads.push_back(std::thread(worker));
+	for(std::thread& thread : threads)
+		thread.join();
+
+	std::vector<MonteCarloResult> results(grid.size());
+	for(size_t g = 0; g < grid.size(); g++)
+	{
+		MonteCarloResult& result = results[g];
+		result.std_a = grid[g].std_a;
+		result.std_yawdd = grid[g].std_yawdd;
+		result.runs = config.runs;
+		result.passed = 0;
+		result.updates = 0;
+		result.filterSeconds = 0;
+		result.lidarNis = NisMonitor(kLidarNisBound);
+		result.radarNis = NisMonitor(kRadarNisBound);
+		for(int k = 0; k < 4; k++)
+			result.meanRmse[k] = result.worstRmse[k] = 0;
+
+		for(int r = 0; r < config.runs; r++)
+		{
+			const RunStats& run = stats[g * config.runs + r];
+			result.passed += run.passed;
+			result.updates += run.updates;
+			result.filterSeconds += run.filterSeconds;
+			for(int k = 0; k < 4; k++)
+			{
+				result.meanRmse[k] += run.rmse[k] / config.runs;
+				result.worstRmse[k] = std::max(result.worstRmse[k], run.rmse[k]);
+			}
+			result.lidarNis.merge(run.lidarNis);
+			result.radarNis.merge(run.radarNis);
+		}
+	}
+	return results;
+}
@@ -0,0 +1,69 @@
+#ifndef MONTE_CARLO_H_
+#define MONTE_CARLO_H_
+
+#include <type_traits>
+#include <vector>
+#include "metrics.h"
+#include "scenario.h"
+#include "ukf.h"
+
+struct MonteCarloConfig
+{
+	// traffic replayed by every run, unless numCars > 0
+	Scenario scenario;
+	// generate a fresh scenario of this many cars for every seed
+	int numCars;
+	// seeds per grid point, run i uses seed firstSeed + i
+	int runs;
+	unsigned int firstSeed;
+	// filter parameter grid, every combination is run
+	std::vector<double> stdA;
+	std::vector<double> stdYawdd;
+	// worker threads, 0 for one per core
+	int threads;
+	double duration_s;
+	int framesPerSec;
+	// same bounds as Highway::rmseThreshold, checked after the first second
+	std::vector<double> rmseThreshold;
+	// run UKFT<float> instead of UKFT<double>, defaults to the filter the build tracks with
+	bool singlePrecision;
+	// track with the n+2 point spherical simplex set and its center weight instead of the symmetric one
+	bool simplexSigmaPoints;
+	double simplexW0;
+
+	MonteCarloConfig()
+		: scenario(Scenario::highway()), numCars(0), runs(100), firstSeed(0),
+		  stdA(1, 1.0), stdYawdd(1, 0.3), threads(0), duration_s(10), framesPerSec(30),
+		  rmseThreshold({0.30, 0.16, 0.95, 0.70}), singlePrecision(std::is_same<UKF, UKFT<float> >::value),
+		  simplexSigmaPoints(false), simplexW0(0.2)
+	{}
+};
+
+// aggregate over all runs of one grid point
+struct MonteCarloResult
+{
+	double std_a;
+	double std_yawdd;
+	int runs;
+	// runs whose RMSE stayed below rmseThreshold, as judged by Highway
+	int passed;
+	// final px, py, vx, vy RMSE, mean and worst over runs
+	double meanRmse[4];
+	double worstRmse[4];
+	NisMonitor lidarNis;
+	NisMonitor radarNis;
+	// measurement updates, and the time spent in ProcessMeasurement summed over threads
+	long long updates;
+	double filterSeconds;
+
+	double updatesPerSecond() const { return filterSeconds > 0 ? updates / filterSeconds : 0; }
+};
+
+/**
+ * Headless replay of the highway sensing and tracking loop: the same
+ * kinematics, sensor models and noise as Highway::stepHighway without
+ * rendering. Seed 0 reproduces the noise of the viewer exactly.
+ */
+std::vector<MonteCarloResult> runMonteCarlo(const MonteCarloConfig& config);
+
+#endif /* MONTE_CARLO_H_ */
@@ -0,0 +1,222 @@
+// Headless Monte Carlo sweep of the UKF process noise over seeded highway runs
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "monte_carlo.h"
+
+// a single value or lo:hi:steps for an evenly spaced grid
+std::vector<double> parseGrid(const std::string& text)
+{
+	double lo, hi;
+	int steps;
+	if(std::sscanf(text.c_str(), "%lf:%lf:%d", &lo, &hi, &steps) == 3 && steps > 1)
+	{
+		std::vector<double> grid;
+		for(int i = 0; i < steps; i++)
+			grid.push_back(lo + (hi - lo) * i / (steps - 1));
+		return grid;
+	}
+	return std::vector<double>(1, std::atof(text.c_str()));
+}
+
+// filter configuration of one pass over the grid
+struct Variant
+{
+	bool singlePrecision;
+	bool simplex;
+
+	std::string name() const
+	{
+		return std::string(singlePrecision ? "float" : "double") + (simplex ? "/simplex" : "");
+	}
+};
+
+// total update rate of the results of one variant
+double updatesPerSecond(const std::vector<MonteCarloResult>& results, const std::vector<int>& variantOf, int variant)
+{
+	long long updates = 0;
+	double seconds = 0;
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		if(variantOf[i] != variant)
+			continue;
+		updates += results[i].updates;
+		seconds += results[i].filterSeconds;
+	}
+	return seconds > 0 ? updates / seconds : 0;
+}
+
+int main(int argc, char** argv)
+{
+	// options: --runs <n> seeds per grid point, --seed <first seed>, --threads <n>
+	//          --std-a <grid> --std-yawdd <grid> process noise grids, value or lo:hi:steps
+	//          --cars <n> generate a new scenario per seed, --scenario <file> replay a saved one
+	//          --csv <file> write the table as CSV
+	//          --precision double|float|both filters to run, the build's UKF by default
+	//          --sigma-points symmetric|simplex|both sigma point sets to run, --simplex-w0 <w> center weight of the simplex set
+	//          --require-pass <percent> exit with 1 if fewer runs of any grid point stay within rmseThreshold
+	//          with both precisions it also exits with 1 if float keeps fewer runs within rmseThreshold than double
+	MonteCarloConfig config;
+	std::string csvFile;
+	std::vector<bool> precisions(1, config.singlePrecision);
+	std::vector<bool> sigmaSets(1, false);
+	double requirePass = 0;
+	for(int i = 1; i+1 < argc; i += 2)
+	{
+		std::string option = argv[i], value = argv[i+1];
+		if(option == "--runs")
+			config.runs = std::atoi(value.c_str());
+		else if(option == "--seed")
+			config.firstSeed = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+		else if(option == "--threads")
+			config.threads = std::atoi(value.c_str());
+		else if(option == "--std-a")
+			config.stdA = parseGrid(value);
+		else if(option == "--std-yawdd")
+			config.stdYawdd = parseGrid(value);
+		else if(option == "--cars")
+			config.numCars = std::atoi(value.c_str());
+		else if(option == "--csv")
+			csvFile = value;
+		else if(option == "--precision")
+		{
+			precisions.clear();
+			if(value == "double" || value == "both")
+				precisions.push_back(false);
+			if(value == "float" || value == "both")
+				precisions.push_back(true);
+			if(precisions.empty())
+			{
+				std::cerr << "Unknown precision " << value << std::endl;
+				return 1;
+			}
+		}
+		else if(option == "--sigma-points")
+		{
+			sigmaSets.clear();
+			if(value == "symmetric" || value == "both")
+				sigmaSets.push_back(false);
+			if(value == "simplex" || value == "both")
+				sigmaSets.push_back(true);
+			if(sigmaSets.empty())
+			{
+				std::cerr << "Unknown sigma point set " << value << std::endl;
+				return 1;
+			}
+		}
+		else if(option == "--simplex-w0")
+			config.simplexW0 = std::atof(value.c_str());
+		else if(option == "--require-pass")
+			requirePass = std::atof(value.c_str());
+		else if(option == "--scenario")
+		{
+			if(!config.scenario.load(value))
+			{
+				std::cerr << "Couldn't load scenario " << value << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			return 1;
+		}
+	}
+	// no runs would make every pass rate 0/0
+	if(config.runs < 1)
+	{
+		std::cerr << "--runs must be at least 1, got " << config.runs << std::endl;
+		return 1;
+	}
+
+	std::vector<Variant> variants;
+	for(bool simplex : sigmaSets)
+		for(bool singlePrecision : precisions)
+			variants.push_back(Variant{singlePrecision, simplex});
+
+	// results of all variants, grid points in the same order for each
+	std::vector<MonteCarloResult> results;
+	std::vector<int> variantOf;
+	for(size_t v = 0; v < variants.size(); v++)
+	{
+		config.singlePrecision = variants[v].singlePrecision;
+		config.simplexSigmaPoints = variants[v].simplex;
+		std::vector<MonteCarloResult> run = runMonteCarlo(config);
+		results.insert(results.end(), run.begin(), run.end());
+		variantOf.insert(variantOf.end(), run.size(), (int)v);
+	}
+	const size_t points = results.size() / variants.size();
+
+	std::printf("%-14s %8s %9s %6s %6s | %-31s | %-31s | %-19s | %s\n", "filter", "std_a", "std_yawdd", "runs", "pass%",
+		"mean RMSE  x     y     vx    vy", "worst RMSE x     y     vx    vy", "NIS<95% lidar radar", "updates/s/thread");
+	bool failed = false;
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const MonteCarloResult& r = results[i];
+		std::printf("%-14s %8.3f %9.3f %6d %6.1f | %7.4f %7.4f %7.4f %7.4f | %7.4f %7.4f %7.4f %7.4f | %9.3f %5.3f | %10.0f\n",
+			variants[variantOf[i]].name().c_str(), r.std_a, r.std_yawdd, r.runs, 100.0 * r.passed / r.runs,
+			r.meanRmse[0], r.meanRmse[1], r.meanRmse[2], r.meanRmse[3],
+			r.worstRmse[0], r.worstRmse[1], r.worstRmse[2], r.worstRmse[3],
+			r.lidarNis.consistentRatio(), r.radarNis.consistentRatio(), r.updatesPerSecond());
+		if(100.0 * r.passed / r.runs < requirePass)
+			failed = true;
+	}
+	std::printf("thresholds %.2f %.2f %.2f %.2f\n", config.rmseThreshold[0], config.rmseThreshold[1], config.rmseThreshold[2], config.rmseThreshold[3]);
+
+	// compare variants that differ in one setting; with both precisions float has to pass wherever double does
+	for(size_t a = 0; a < variants.size(); a++)
+	{
+		for(size_t b = 0; b < variants.size(); b++)
+		{
+			bool floatOverDouble = !variants[a].singlePrecision && variants[b].singlePrecision && variants[a].simplex == variants[b].simplex;
+			bool simplexOverSymmetric = !variants[a].simplex && variants[b].simplex && variants[a].singlePrecision == variants[b].singlePrecision;
+			if(!floatOverDouble && !simplexOverSymmetric)
+				continue;
+			std::printf("%s / %s throughput %.2fx\n", variants[b].name().c_str(), variants[a].name().c_str(),
+				updatesPerSecond(results, variantOf, (int)b) / updatesPerSecond(results, variantOf, (int)a));
+			if(!floatOverDouble)
+				continue;
+			for(size_t g = 0; g < points; g++)
+			{
+				const MonteCarloResult& reference = results[a * points + g];
+				const MonteCarloResult& single = results[b * points + g];
+				if(single.passed < reference.passed)
+				{
+					std::cerr << variants[b].name() << " passes " << single.passed << " runs at std_a " << reference.std_a << " std_yawdd "
+						<< reference.std_yawdd << ", " << variants[a].name() << " " << reference.passed << std::endl;
+					failed = true;
+				}
+			}
+		}
+	}
+
+	if(!csvFile.empty())
+	{
+		std::ofstream out(csvFile.c_str());
+		out << "filter,std_a,std_yawdd,runs,passed,mean_x,mean_y,mean_vx,mean_vy,worst_x,worst_y,worst_vx,worst_vy,nis_lidar_consistent,nis_radar_consistent,updates_per_s\n";
+		for(size_t i = 0; i < results.size(); i++)
+		{
+			const MonteCarloResult& r = results[i];
+			out << variants[variantOf[i]].name() << "," << r.std_a << "," << r.std_yawdd << "," << r.runs << "," << r.passed;
+			for(int k = 0; k < 4; k++)
+				out << "," << r.meanRmse[k];
+			for(int k = 0; k < 4; k++)
+				out << "," << r.worstRmse[k];
+			out << "," << r.lidarNis.consistentRatio() << "," << r.radarNis.consistentRatio() << "," << r.updatesPerSecond() << "\n";
+		}
+		if(!out)
+		{
+			std::cerr << "Couldn't write " << csvFile << std::endl;
+			return 1;
+		}
+	}
+	if(failed)
+	{
+		std::cerr << "Too few runs stayed within rmseThreshold" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Bounded lock-free multi producer single consumer queue after Dmitry
+ * Vyukov's bounded MPMC queue. Every cell carries a sequence number that
+ * tells producers and the consumer whose turn it is, so producers only
+ * contend on one compare-and-swap of the enqueue position and the
+ * consumer never writes shared state besides the cell it frees. All cells
+ * are allocated up front; T should be trivially copyable.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit MpscQueue(size_t capacity)
+		: cells(roundUp(capacity)), mask(cells.size() - 1), enqueuePos(0), dequeuePos(0)
+	{
+		for(size_t i = 0; i < cells.size(); i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	size_t capacity() const { return cells.size(); }
+
+	/**
+	 * Any thread
+	 * @return false if the queue is full
+	 */
+	bool tryPush(const T& value)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		for(;;)
+		{
+			Cell& cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+			if(difference == 0)
+			{
+				if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.value = value;
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(difference < 0)
+				return false;
+			else
+				pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * Consumer thread only
+	 * @return false if the queue is empty
+	 */
+	bool tryPop(T& value)
+	{
+		Cell& cell = cells[dequeuePos & mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if((std::ptrdiff_t)sequence - (std::ptrdiff_t)(dequeuePos + 1) < 0)
+			return false;
+		value = cell.value;
+		cell.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+		dequeuePos++;
+		return true;
+	}
+
+	// consumer thread, entries pushed but not yet popped
+	size_t depth() const
+	{
+		return enqueuePos.load(std::memory_order_relaxed) - dequeuePos;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+
+		Cell() : sequence(0), value() {}
+		Cell(const Cell& other) : sequence(other.sequence.load()), value(other.value) {}
+	};
+
+	static size_t roundUp(size_t n)
+	{
+		size_t power = 2;
+		while(power < n)
+			power <<= 1;
+		return power;
+	}
+
+	std::vector<Cell> cells;
+	const size_t mask;
+	// producers and the consumer touch different cache lines
+	alignas(64) std::atomic<size_t> enqueuePos;
+	alignas(64) size_t dequeuePos;
+};
+
+#endif /* MPSC_QUEUE_H_ */
@@ -0,0 +1,136 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "metrics.h"
+
+/**
+ * Frames flow through a fixed chain of stages, each stage on its own
+ * thread, so stage i of frame k+1 runs while stage i+1 works on frame k.
+ * At most maxInFlight frames are between submit() and the end of the last
+ * stage; submit() blocks beyond that, which holds a fast producer back
+ * instead of letting the queues grow. Stages see frames in submission
+ * order, so a stage may keep state from one frame to the next.
+ */
+template <typename Frame>
+class Pipeline
+{
+public:
+	typedef std::function<void(Frame&)> Stage;
+	// called on the last stage's thread with the frame's submit to finish time
+	typedef std::function<void(const Frame&, long long latency_us)> Completion;
+
+	Pipeline(const std::vector<Stage>& setStages, int setMaxInFlight, const Completion& setCompleted = Completion())
+		: stageTime(setStages.size()), stages(setStages), completed(setCompleted), maxInFlight(std::max(1, setMaxInFlight)),
+		  inFlight(0), stopping(false), queues(setStages.size())
+	{
+		for(size_t i = 0; i < stages.size(); i++)
+			threads.push_back(std::thread(&Pipeline::run, this, i));
+	}
+
+	// finishes the frames in flight
+	~Pipeline()
+	{
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		ready.notify_all();
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+
+	void submit(const Frame& frame)
+	{
+		std::unique_ptr<Entry> entry(new Entry());
+		entry->frame = frame;
+		std::unique_lock<std::mutex> lock(mutex);
+		slotFree.wait(lock, [this]() { return inFlight < maxInFlight; });
+		inFlight++;
+		entry->submitted = std::chrono::steady_clock::now();
+		queues[0].push_back(std::move(entry));
+		ready.notify_all();
+	}
+
+	// wait until every submitted frame went through all stages
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		slotFree.wait(lock, [this]() { return inFlight == 0; });
+	}
+
+	// end to end latency of the finished frames in microseconds, read after flush()
+	LogHistogram latency;
+	// time each stage spent on a frame in microseconds, without the waits between stages
+	std::vector<LogHistogram> stageTime;
+
+private:
+	struct Entry
+	{
+		Frame frame;
+		std::chrono::steady_clock::time_point submitted;
+	};
+
+	void run(size_t stage)
+	{
+		for(;;)
+		{
+			std::unique_ptr<Entry> entry;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [&]() { return stopping || !queues[stage].empty(); });
+				if(queues[stage].empty())
+					return;
+				entry = std::move(queues[stage].front());
+				queues[stage].pop_front();
+			}
+
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			stages[stage](entry->frame);
+			stageTime[stage].record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+
+			if(stage + 1 < stages.size())
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queues[stage+1].push_back(std::move(entry));
+				ready.notify_all();
+				continue;
+			}
+
+			long long latency_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - entry->submitted).count();
+			latency.record(latency_us);
+			if(completed)
+				completed(entry->frame, latency_us);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				inFlight--;
+			}
+			slotFree.notify_all();
+		}
+	}
+
+	const std::vector<Stage> stages;
+	const Completion completed;
+	const int maxInFlight;
+
+	std::mutex mutex;
+	// a stage queue got a frame, or the pipeline stops
+	std::condition_variable ready;
+	// a frame left the pipeline
+	std::condition_variable slotFree;
+	int inFlight;
+	bool stopping;
+	std::vector<std::deque<std::unique_ptr<Entry> > > queues;
+	std::vector<std::thread> threads;
+};
+
+#endif /* PIPELINE_H_ */
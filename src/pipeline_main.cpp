@@ -0,0 +1,169 @@
+// Headless lidar tracking through the pipelined scan, detect, associate and update stages
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "event_queue.h"
+#include "kinematics.h"
+#include "scenario.h"
+#include "sensor_pipeline.h"
+
+int main(int argc, char** argv)
+{
+	// options: --frames <n> sweeps to run, --in-flight <n> frames in the pipeline at once, 1 runs the stages serially
+	//          --workers <n> tracker threads, --period <s> sweep period
+	//          --realtime 1 submit a sweep per period instead of as fast as the pipeline takes them
+	//          --cars <n> --seed <seed> generate a scenario, --scenario <file> replay a saved one
+	//          --csv <file> write the latency and tracking error of every frame
+	SensorPipelineConfig config;
+	int numFrames = 100;
+	int numCars = 0;
+	bool realtime = false;
+	unsigned int seed = 0;
+	std::string scenarioFile, csvFile;
+	for(int i = 1; i+1 < argc; i += 2)
+	{
+		std::string option = argv[i], value = argv[i+1];
+		if(option == "--frames")
+			numFrames = std::atoi(value.c_str());
+		else if(option == "--in-flight")
+			config.maxInFlight = std::atoi(value.c_str());
+		else if(option == "--workers")
+			config.workers = std::atoi(value.c_str());
+		else if(option == "--period")
+			config.period_s = std::atof(value.c_str());
+		else if(option == "--realtime")
+			realtime = std::atoi(value.c_str()) != 0;
+		else if(option == "--cars")
+			numCars = std::atoi(value.c_str());
+		else if(option == "--seed")
+			seed = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+		else if(option == "--scenario")
+			scenarioFile = value;
+		else if(option == "--csv")
+			csvFile = value;
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			return 1;
+		}
+	}
+
+	Scenario scenario = Scenario::highway();
+	if(!scenarioFile.empty() && !scenario.load(scenarioFile))
+	{
+		std::cerr << "Couldn't load scenario " << scenarioFile << std::endl;
+		return 1;
+	}
+	else if(scenarioFile.empty() && numCars > 0)
+		scenario = Scenario::generate(numCars, seed);
+
+	// traffic relative to the ego car, as in Highway
+	KinematicsWorld world;
+	ActuationQueue actuations;
+	std::vector<Car> traffic;
+	for(size_t i = 0; i < scenario.cars.size(); i++)
+	{
+		const ScenarioCar& sc = scenario.cars[i];
+		traffic.push_back(Car(Vect3(sc.x, sc.y, 0), Vect3(4, 2, 2), Color(0, 0, 1), sc.velocity, sc.angle, 2, "car"+std::to_string(i+1)));
+		int index = world.add(sc.x, sc.y, sc.velocity, sc.angle, 2);
+		for(uint32_t e = sc.firstEvent; e < sc.firstEvent + sc.numEvents; e++)
+			actuations.push(scenario.events[e].time_us, index, scenario.events[e].acceleration, scenario.events[e].steering);
+	}
+
+	// error of the track nearest to every car at the end of its sweep, written by the update stage only
+	double squaredError[4] = {0, 0, 0, 0};
+	long long matched = 0, missed = 0;
+	std::ofstream csv;
+	if(!csvFile.empty())
+	{
+		csv.open(csvFile.c_str());
+		csv << "timestamp,latency_us,detections,tracks,matched,missed\n";
+	}
+
+	auto completed = [&](const SensorFrame& frame, long long latency_us)
+	{
+		long long frameMatched = 0, frameMissed = 0;
+		for(const Car& car : frame.end)
+		{
+			const TrackSummary* nearest = nullptr;
+			double nearestDistance = config.gate;
+			long long end = frame.timestamp + (long long)(config.period_s * 1e6);
+			for(const TrackSummary& track : frame.tracks)
+			{
+				double dt = (end - track.timestamp) / 1e6;
+				double distance = std::hypot(track.x + track.vx*dt - car.position.x, track.y + track.vy*dt - car.position.y);
+				if(distance <= nearestDistance)
+				{
+					nearest = &track;
+					nearestDistance = distance;
+				}
+			}
+			if(!nearest)
+			{
+				frameMissed++;
+				continue;
+			}
+			double dt = (end - nearest->timestamp) / 1e6;
+			double error[4] = {nearest->x + nearest->vx*dt - car.position.x, nearest->y + nearest->vy*dt - car.position.y,
+				nearest->vx - car.velocity*std::cos(car.angle), nearest->vy - car.velocity*std::sin(car.angle)};
+			for(int k = 0; k < 4; k++)
+				squaredError[k] += error[k]*error[k];
+			frameMatched++;
+		}
+		matched += frameMatched;
+		missed += frameMissed;
+		if(csv.is_open())
+			csv << frame.timestamp << "," << latency_us << "," << frame.detections.size() << "," << frame.tracks.size() << ","
+				<< frameMatched << "," << frameMissed << "\n";
+	};
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	{
+		SensorPipeline pipeline(config, completed);
+		const long long period_us = (long long)(config.period_s * 1e6);
+		for(int frame = 0; frame < numFrames; frame++)
+		{
+			long long timestamp = frame * period_us;
+			std::vector<Car> start = traffic;
+			actuations.applyDue(timestamp, world);
+			world.step(config.period_s);
+			for(size_t i = 0; i < traffic.size(); i++)
+				traffic[i].setPose(world.x[i], world.y[i], world.velocity[i], world.angle[i], world.cosAngle[i], world.sinAngle[i]);
+			if(realtime)
+				std::this_thread::sleep_until(begin + std::chrono::microseconds(timestamp + period_us));
+			pipeline.submit(timestamp, start, traffic);
+		}
+		pipeline.flush();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		const LogHistogram& latency = pipeline.latency();
+		std::printf("%d frames of %zu cars in %.3f s, %.1f frames/s with %d in flight\n", numFrames, traffic.size(), seconds,
+			numFrames / seconds, config.maxInFlight);
+		std::printf("latency us  p50 %lld  p90 %lld  p99 %lld  max %lld\n", latency.percentile(0.5), latency.percentile(0.9),
+			latency.percentile(0.99), latency.max);
+		const char* names[] = {"scan", "detect", "associate", "update"};
+		for(int stage = 0; stage < 4; stage++)
+		{
+			const LogHistogram& time = pipeline.stageTime(stage);
+			std::printf("%-10s mean %8.0f us  p99 %lld\n", names[stage], time.count ? (double)time.sum / time.count : 0.0,
+				time.percentile(0.99));
+		}
+	}
+
+	std::printf("RMSE x %.4f y %.4f vx %.4f vy %.4f over %lld matches, %lld cars without a track\n",
+		matched ? std::sqrt(squaredError[0] / matched) : 0.0, matched ? std::sqrt(squaredError[1] / matched) : 0.0,
+		matched ? std::sqrt(squaredError[2] / matched) : 0.0, matched ? std::sqrt(squaredError[3] / matched) : 0.0,
+		matched, missed);
+	if(csv.is_open() && !csv)
+	{
+		std::cerr << "Couldn't write " << csvFile << std::endl;
+		return 1;
+	}
+	return 0;
+}
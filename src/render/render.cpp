@@ -3,9 +3,11 @@
 // such as cars and the highway
 
 #include "render.h"
+#include "../trace.h"
 
 void renderHighway(double distancePos, pcl::visualization::PCLVisualizer::Ptr& viewer)
 {
+	TRACE_SCOPE("renderHighway");
 
 	// units in meters
 	double roadLengthAhead = 50.0;
@@ -74,6 +76,7 @@ void clearRays(pcl::visualization::PCLVisualizer::Ptr& viewer)
 
 void renderPointCloud(pcl::visualization::PCLVisualizer::Ptr& viewer, const pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, std::string name, Color color)
 {
+	TRACE_SCOPE("renderPointCloud");
 
 	viewer->addPointCloud<pcl::PointXYZ>(cloud, name);
 	viewer->setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 4, name);
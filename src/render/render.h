@@ -6,10 +6,12 @@
 #define RENDER_H
 #include <pcl/visualization/pcl_visualizer.h>
 #include "box.h"
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <string>
 #include "../ukf.h"
+#include "../trace.h"
 
 struct Color
 {
@@ -96,18 +98,12 @@ struct Car
 	// angle around z axis
 	Eigen::Quaternionf getQuaternion(float theta)
 	{
-		Eigen::Matrix3f rotation_mat;
-  		rotation_mat << 
-  		cos(theta), -sin(theta), 0,
-    	sin(theta),  cos(theta), 0,
-    	0, 			 0, 		 1;
-    	
-		Eigen::Quaternionf q(rotation_mat);
-		return q;
+		return Eigen::Quaternionf(cos(theta/2), 0, 0, sin(theta/2));
 	}
 
 	void render(pcl::visualization::PCLVisualizer::Ptr& viewer)
 	{
+		TRACE_SCOPE("Car::render");
 		// render bottom of car
 		viewer->addCube(Eigen::Vector3f(position.x, position.y, dimensions.z*1/3), orientation, dimensions.x, dimensions.y, dimensions.z*2/3, name);
 		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, name);
@@ -136,10 +132,11 @@ struct Car
 		steering = setSteer;
 	}
 
-	void setInstructions(std::vector<accuation> setIn)
+	void setInstructions(const std::vector<accuation>& setIn)
 	{
-		for(accuation a : setIn)
-			instructions.push_back(a);
+		instructions.insert(instructions.end(), setIn.begin(), setIn.end());
+		std::stable_sort(instructions.begin(), instructions.end(),
+			[](const accuation& a, const accuation& b) { return a.time_us < b.time_us; });
 	}
 
 	void setUKF(UKF tracker)
@@ -147,18 +144,20 @@ struct Car
 		ukf = tracker;
 	}
 
-	void move(float dt, int time_us)
+	// apply every instruction whose time has come, so none are skipped with large steps
+	void updateAccuation(int time_us)
 	{
-
-		if(instructions.size() > 0 && accuateIndex < (int)instructions.size()-1)
+		while(accuateIndex < (int)instructions.size()-1 && time_us >= instructions[accuateIndex+1].time_us)
 		{
-			if(time_us >= instructions[accuateIndex+1].time_us)
-			{
-				setAcceleration(instructions[accuateIndex+1].acceleration);
-				setSteering(instructions[accuateIndex+1].steering);
-				accuateIndex++;
-			}
+			setAcceleration(instructions[accuateIndex+1].acceleration);
+			setSteering(instructions[accuateIndex+1].steering);
+			accuateIndex++;
 		}
+	}
+
+	void move(float dt, int time_us)
+	{
+		updateAccuation(time_us);
 
 		position.x += velocity * cos(angle) * dt;
 		position.y += velocity * sin(angle) * dt;
@@ -170,13 +169,29 @@ struct Car
 		cosNegTheta = cos(-angle);
 	}
 
+	// take over the state of a car stepped in a KinematicsWorld
+	void setPose(double x, double y, float setVelocity, float setAngle, float cosAngle, float sinAngle)
+	{
+		position.x = x;
+		position.y = y;
+		velocity = setVelocity;
+		angle = setAngle;
+		// half angle identities, the sign of z follows sin(angle)
+		float halfCos = sqrt(std::max(0.0f, 0.5f*(1+cosAngle)));
+		float halfSin = sqrt(std::max(0.0f, 0.5f*(1-cosAngle)));
+		orientation = Eigen::Quaternionf(halfCos, 0, 0, sinAngle < 0 ? -halfSin : halfSin);
+
+		sinNegTheta = -sinAngle;
+		cosNegTheta = cosAngle;
+	}
+
 	// collision helper function
-	bool inbetween(double point, double center, double range)
+	bool inbetween(double point, double center, double range) const
 	{
 		return (center - range <= point) && (center + range >= point);
 	}
 
-	bool checkCollision(Vect3 point)
+	bool checkCollision(const Vect3& point) const
 	{
 		// check collision for rotated car
 		double xPrime = ((point.x-position.x) * cosNegTheta - (point.y-position.y) * sinNegTheta)+position.x;
@@ -0,0 +1,193 @@
+/* Retained mode rendering of the highway scene */
+
+#include "scene.h"
+#include "../trace.h"
+#include <cmath>
+
+namespace {
+
+// road layout of renderHighway, units in meters
+const double roadLengthAhead = 50.0;
+const double roadLengthBehind = -15.0;
+const double roadWidth = 12.0;
+const double roadHeight = 0.2;
+const double poleSpace = 10;
+const double poleCurve = 4;
+const double poleWidth = 0.5;
+const double poleHeight = 3;
+// height of the track markers above the road
+const float trackHeight = 3.5;
+
+}
+
+Scene::Scene(pcl::visualization::PCLVisualizer::Ptr& setViewer)
+	: viewer(setViewer)
+{}
+
+int Scene::addNode()
+{
+	Node node;
+	node.visible = true;
+	node.opacity = 1.0;
+	nodes.push_back(node);
+	return (int)nodes.size() - 1;
+}
+
+void Scene::setPose(int node, const Eigen::Affine3f& pose)
+{
+	for(const std::string& shape : nodes[node].shapes)
+		viewer->updateShapePose(shape, pose);
+}
+
+void Scene::setVisible(int node, bool visible)
+{
+	if(nodes[node].visible == visible)
+		return;
+	nodes[node].visible = visible;
+	for(const std::string& shape : nodes[node].shapes)
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, visible ? nodes[node].opacity : 0.0, shape);
+}
+
+void Scene::addHighway()
+{
+	viewer->addCube(roadLengthBehind, roadLengthAhead, -roadWidth / 2, roadWidth / 2, -roadHeight, 0, .2, .2, .2, "highwayPavement");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, "highwayPavement");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0, "highwayPavement");
+	viewer->addLine(pcl::PointXYZ(roadLengthBehind, -roadWidth / 6, 0.01), pcl::PointXYZ(roadLengthAhead , -roadWidth / 6, 0.01), 1, 1, 0, "line1");
+	viewer->addLine(pcl::PointXYZ(roadLengthBehind, roadWidth / 6, 0.01), pcl::PointXYZ(roadLengthAhead, roadWidth / 6, 0.01), 1, 1, 0, "line2");
+
+	// enough poles to cover the road at any scroll offset, built around x = 0
+	int numPoles = (int)((roadLengthAhead - roadLengthBehind) / poleSpace) + 1;
+	for(int poleIndex = 0; poleIndex < numPoles; poleIndex++)
+	{
+		int node = addNode();
+		const double side[2] = {1, -1};
+		const char* suffix[2] = {"l", "r"};
+		for(int s = 0; s < 2; s++)
+		{
+			double y = side[s] * (roadWidth / 2 + poleCurve);
+			std::string id = "pole_" + std::to_string(poleIndex) + suffix[s];
+			viewer->addCube(-poleWidth/2, poleWidth/2, -poleWidth/2+y, poleWidth/2+y, 0, poleHeight, 1, 0.5, 0, id);
+			viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, id);
+			viewer->addCube(-poleWidth/2, poleWidth/2, -poleWidth/2+y, poleWidth/2+y, 0, poleHeight, 0, 0, 0, id + "frame");
+			viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, id + "frame");
+			nodes[node].shapes.push_back(id);
+			nodes[node].shapes.push_back(id + "frame");
+		}
+		poles.push_back(node);
+	}
+	updateHighway(0);
+}
+
+void Scene::updateHighway(double distancePos)
+{
+	TRACE_SCOPE("Scene::updateHighway");
+	// first marker at or behind the end of the road, as in renderHighway
+	double offset = std::fmod(-distancePos, poleSpace);
+	if(offset < 0)
+		offset += poleSpace;
+	for(size_t i = 0; i < poles.size(); i++)
+	{
+		double markerPos = roadLengthBehind + offset + i * poleSpace;
+		bool visible = markerPos <= roadLengthAhead;
+		setVisible(poles[i], visible);
+		if(visible)
+			setPose(poles[i], Eigen::Affine3f(Eigen::Translation3f(markerPos, 0, 0)));
+	}
+}
+
+int Scene::addCar(const Car& car)
+{
+	int node = addNode();
+	const std::string& name = car.name;
+	const Vect3& dimensions = car.dimensions;
+	const Color& color = car.color;
+	Eigen::Quaternionf identity = Eigen::Quaternionf::Identity();
+
+	// bottom of car
+	viewer->addCube(Eigen::Vector3f(0, 0, dimensions.z*1/3), identity, dimensions.x, dimensions.y, dimensions.z*2/3, name);
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, name);
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, name);
+	viewer->addCube(Eigen::Vector3f(0, 0, dimensions.z*1/3), identity, dimensions.x, dimensions.y, dimensions.z*2/3, name+"frame");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 0, name+"frame");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, name+"frame");
+
+	// top of car
+	viewer->addCube(Eigen::Vector3f(0, 0, dimensions.z*5/6), identity, dimensions.x/2, dimensions.y, dimensions.z*1/3, name+"Top");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, color.r, color.g, color.b, name+"Top");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_SURFACE, name+"Top");
+	viewer->addCube(Eigen::Vector3f(0, 0, dimensions.z*5/6), identity, dimensions.x/2, dimensions.y, dimensions.z*1/3, name+"Topframe");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 0, name+"Topframe");
+	viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, name+"Topframe");
+
+	nodes[node].shapes.push_back(name);
+	nodes[node].shapes.push_back(name+"frame");
+	nodes[node].shapes.push_back(name+"Top");
+	nodes[node].shapes.push_back(name+"Topframe");
+	setPose(node, Eigen::Translation3f(car.position.x, car.position.y, 0) * car.orientation);
+	return node;
+}
+
+void Scene::updateCar(int node, const CarSnapshot& car)
+{
+	setVisible(node, car.visible);
+	if(car.visible)
+		setPose(node, Eigen::Translation3f(car.x, car.y, 0) * Eigen::Quaternionf(car.qw, 0, 0, car.qz));
+}
+
+int Scene::addTrack(const std::string& name, int steps)
+{
+	std::vector<int> track;
+
+	int estimate = addNode();
+	viewer->addSphere(pcl::PointXYZ(0, 0, 0), 0.5, 0, 1, 0, name+"_ukf");
+	nodes[estimate].shapes.push_back(name+"_ukf");
+	track.push_back(estimate);
+
+	// unit line along x, scaled by the speed and turned by the yaw
+	int velocity = addNode();
+	viewer->addLine(pcl::PointXYZ(0, 0, 0), pcl::PointXYZ(1, 0, 0), 0, 1, 0, name+"_ukf_vel");
+	nodes[velocity].shapes.push_back(name+"_ukf_vel");
+	track.push_back(velocity);
+
+	for(int k = 1; k <= steps; k++)
+	{
+		int forecast = addNode();
+		std::string id = name+"_ukf"+std::to_string(k);
+		viewer->addSphere(pcl::PointXYZ(0, 0, 0), 0.5, 0, 1, 0, id);
+		nodes[forecast].opacity = 1.0-0.8*k/steps;
+		viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, nodes[forecast].opacity, id);
+		nodes[forecast].shapes.push_back(id);
+		track.push_back(forecast);
+	}
+
+	tracks.push_back(track);
+	return (int)tracks.size() - 1;
+}
+
+void Scene::updateTrack(int node, const TrackSnapshot& snapshot)
+{
+	TRACE_SCOPE("Scene::updateTrack");
+	const std::vector<int>& track = tracks[node];
+
+	setPose(track[0], Eigen::Affine3f(Eigen::Translation3f(snapshot.px, snapshot.py, trackHeight)));
+	// keep the scale invertible for a car at rest
+	float length = std::fabs(snapshot.v) < 1e-3f ? 1e-3f : snapshot.v;
+	setPose(track[1], Eigen::Translation3f(snapshot.px, snapshot.py, trackHeight) * Eigen::AngleAxisf(snapshot.yaw, Eigen::Vector3f::UnitZ()) * Eigen::Scaling(length, 1.0f, 1.0f));
+
+	for(size_t k = 2; k < track.size(); k++)
+	{
+		bool visible = k-2 < snapshot.forecast.size();
+		setVisible(track[k], visible);
+		if(visible)
+			setPose(track[k], Eigen::Affine3f(Eigen::Translation3f(snapshot.forecast[k-2].x, snapshot.forecast[k-2].y, trackHeight)));
+	}
+}
+
+void Scene::text(const std::string& content, int x, int y, int size, double r, double g, double b, const std::string& id)
+{
+	if(texts.insert(id).second)
+		viewer->addText(content, x, y, size, r, g, b, id);
+	else
+		viewer->updateText(content, x, y, size, r, g, b, id);
+}
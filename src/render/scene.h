@@ -0,0 +1,62 @@
+/* Retained mode rendering of the highway scene */
+
+#ifndef SCENE_H
+#define SCENE_H
+#include "render.h"
+#include "../frame_snapshot.h"
+#include <set>
+
+/**
+ * Every shape of the scene is created once, with its geometry built around
+ * the origin, and afterwards only moved with updateShapePose or faded
+ * through its opacity. A frame therefore costs a few VTK property updates
+ * per object instead of tearing down and rebuilding all actors, and no
+ * shape ids are formatted after setup.
+ */
+class Scene
+{
+public:
+
+	explicit Scene(pcl::visualization::PCLVisualizer::Ptr& setViewer);
+
+	// road, lane markings and the scrolling poles, same layout as renderHighway
+	void addHighway();
+	// poles scroll by the distance the ego car has traveled
+	void updateHighway(double distancePos);
+
+	// the four cubes of Car::render, returns the node of the car
+	int addCar(const Car& car);
+	void updateCar(int node, const CarSnapshot& car);
+
+	// estimate, velocity and forecast markers of a tracked car, as Tools::ukfResults
+	int addTrack(const std::string& name, int steps);
+	// forecast spheres beyond the snapshot's forecast are hidden
+	void updateTrack(int node, const TrackSnapshot& track);
+
+	// addText the first time, updateText afterwards
+	void text(const std::string& content, int x, int y, int size, double r, double g, double b, const std::string& id);
+
+private:
+
+	struct Node
+	{
+		std::vector<std::string> shapes;
+		bool visible;
+		// opacity while visible
+		double opacity;
+	};
+
+	int addNode();
+	void setPose(int node, const Eigen::Affine3f& pose);
+	void setVisible(int node, bool visible);
+
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	std::vector<Node> nodes;
+	// nodes of the poles, left and right of each marker
+	std::vector<int> poles;
+	// per track: estimate, velocity line and forecast spheres
+	std::vector<std::vector<int> > tracks;
+	std::set<std::string> texts;
+};
+
+#endif
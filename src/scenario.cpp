@@ -0,0 +1,147 @@
+#include "scenario.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace {
+
+const char kScenarioMagic[8] = {'U', 'K', 'F', 'S', 'C', 'N', '1', '\0'};
+
+struct ScenarioHeader
+{
+	char magic[8];
+	uint32_t numCars;
+	uint32_t numEvents;
+};
+
+}
+
+Scenario Scenario::generate(int numCars, unsigned int seed, const ScenarioOptions& options)
+{
+	Scenario scenario;
+	scenario.cars.reserve(numCars);
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	auto uniform = [&](double lo, double hi) { return lo + (hi - lo) * unit(rng); };
+
+	const int64_t duration_us = (int64_t)(options.duration_s * 1e6);
+	std::vector<double> laneEnd(options.numLanes, -15.0);
+
+	for(int i = 0; i < numCars; i++)
+	{
+		// fill the lanes round robin, each car behind the previous one of its lane
+		int lane = i % options.numLanes;
+		double x = laneEnd[lane] + uniform(0, options.carSpacing);
+		laneEnd[lane] = x + options.carLength + options.carSpacing;
+
+		ScenarioCar car;
+		car.x = (float)x;
+		car.y = (float)((lane - options.numLanes / 2) * options.laneWidth);
+		car.velocity = (float)uniform(options.minVelocity, options.maxVelocity);
+		car.angle = 0;
+		car.firstEvent = (uint32_t)scenario.events.size();
+
+		double v = car.velocity;
+		int64_t t = (int64_t)(uniform(options.minHold, options.maxHold) * 1e6);
+		while(t < duration_us)
+		{
+			double hold = uniform(options.minHold, options.maxHold);
+			int64_t pulse_us = (int64_t)(options.laneChangePulse * 1e6);
+			int target = lane + (unit(rng) < 0.5 ? -1 : 1);
+			bool laneChange = unit(rng) < options.laneChangeProbability && std::fabs(v) >= 2
+				&& target >= 0 && target < options.numLanes && t + 2 * pulse_us < duration_us;
+
+			if(laneChange)
+			{
+				// two opposite steering pulses of duration T shift the car
+				// sideways by about v^2 s T^2 / Lf, solve that for one lane
+				double T = options.laneChangePulse;
+				float steer = (float)((target - lane) * options.laneWidth * options.Lf / (v * v * T * T));
+				ScenarioEvent start = {t, 0.0f, steer};
+				ScenarioEvent counter = {t + pulse_us, 0.0f, -steer};
+				ScenarioEvent straight = {t + 2 * pulse_us, 0.0f, 0.0f};
+				scenario.events.push_back(start);
+				scenario.events.push_back(counter);
+				scenario.events.push_back(straight);
+				lane = target;
+				t += 2 * pulse_us;
+			}
+			else
+			{
+				// keep the velocity inside its range until the next event
+				double acc = uniform(options.minAcceleration, options.maxAcceleration);
+				acc = std::max(acc, (options.minVelocity - v) / hold);
+				acc = std::min(acc, (options.maxVelocity - v) / hold);
+				ScenarioEvent event = {t, (float)acc, 0.0f};
+				scenario.events.push_back(event);
+				v += acc * hold;
+			}
+			t += (int64_t)(hold * 1e6);
+		}
+
+		car.numEvents = (uint32_t)scenario.events.size() - car.firstEvent;
+		scenario.cars.push_back(car);
+	}
+	return scenario;
+}
+
+Scenario Scenario::highway()
+{
+	Scenario scenario;
+	const ScenarioCar cars[] = {
+		{-10, 4, 5, 0, 0, 4},
+		{25, -4, -6, 0, 4, 2},
+		{-12, 0, 1, 0, 6, 7}};
+	const ScenarioEvent events[] = {
+		{500000, 0.5, 0.0}, {2200000, 0.0, -0.2}, {3300000, 0.0, 0.2}, {4400000, -2.0, 0.0},
+		{4000000, 3.0, 0.0}, {8000000, 0.0, 0.0},
+		{500000, 2.0, 1.0}, {1000000, 2.5, 0.0}, {3200000, 0.0, -1.0}, {3300000, 2.0, 0.0},
+		{4500000, 0.0, 0.0}, {5500000, -2.0, 0.0}, {7500000, 0.0, 0.0}};
+	scenario.cars.assign(cars, cars + sizeof(cars) / sizeof(cars[0]));
+	scenario.events.assign(events, events + sizeof(events) / sizeof(events[0]));
+	return scenario;
+}
+
+bool Scenario::save(const std::string& file) const
+{
+	FILE* out = fopen(file.c_str(), "wb");
+	if(!out)
+		return false;
+	ScenarioHeader header;
+	std::memcpy(header.magic, kScenarioMagic, sizeof(header.magic));
+	header.numCars = (uint32_t)cars.size();
+	header.numEvents = (uint32_t)events.size();
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+		&& fwrite(cars.data(), sizeof(ScenarioCar), cars.size(), out) == cars.size()
+		&& fwrite(events.data(), sizeof(ScenarioEvent), events.size(), out) == events.size();
+	return fclose(out) == 0 && ok;
+}
+
+bool Scenario::load(const std::string& file)
+{
+	FILE* in = fopen(file.c_str(), "rb");
+	if(!in)
+		return false;
+	ScenarioHeader header;
+	bool ok = fread(&header, sizeof(header), 1, in) == 1
+		&& std::memcmp(header.magic, kScenarioMagic, sizeof(header.magic)) == 0;
+	if(ok)
+	{
+		cars.resize(header.numCars);
+		events.resize(header.numEvents);
+		ok = fread(cars.data(), sizeof(ScenarioCar), cars.size(), in) == cars.size()
+			&& fread(events.data(), sizeof(ScenarioEvent), events.size(), in) == events.size();
+	}
+	fclose(in);
+	for(size_t i = 0; ok && i < cars.size(); i++)
+		ok = (uint64_t)cars[i].firstEvent + cars[i].numEvents <= events.size();
+	if(!ok)
+	{
+		cars.clear();
+		events.clear();
+	}
+	return ok;
+}
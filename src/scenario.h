@@ -0,0 +1,82 @@
+#ifndef SCENARIO_H_
+#define SCENARIO_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// actuation change of one car, same meaning as accuation in render.h
+struct ScenarioEvent
+{
+	int64_t time_us;
+	float acceleration;
+	float steering;
+};
+
+// initial state of one car and the range of its events in Scenario::events
+struct ScenarioCar
+{
+	float x, y;
+	float velocity;
+	float angle;
+	uint32_t firstEvent;
+	uint32_t numEvents;
+};
+
+struct ScenarioOptions
+{
+	// simulated time the actuation profiles cover
+	double duration_s;
+	// lane centers are at (i - numLanes/2) * laneWidth
+	int numLanes;
+	double laneWidth;
+	// minimum bumper to bumper gap when placing cars in a lane
+	double carSpacing;
+	double carLength;
+	// velocity range relative to the ego car in m/s
+	double minVelocity, maxVelocity;
+	// acceleration range in m/s^2
+	double minAcceleration, maxAcceleration;
+	// seconds between actuation events
+	double minHold, maxHold;
+	// chance that an event is a lane change instead of an acceleration change
+	double laneChangeProbability;
+	// duration of each of the two steering pulses of a lane change
+	double laneChangePulse;
+	// distance between front of vehicle and center of gravity, as Car::Lf
+	double Lf;
+
+	ScenarioOptions()
+		: duration_s(10), numLanes(3), laneWidth(4), carSpacing(4), carLength(4),
+		  minVelocity(-6), maxVelocity(6), minAcceleration(-2), maxAcceleration(3),
+		  minHold(0.5), maxHold(3), laneChangeProbability(0.3), laneChangePulse(1.0), Lf(2)
+	{}
+};
+
+/**
+ * Procedurally generated traffic for Highway. Cars and their time sorted
+ * actuation events are stored in two flat arrays so that scenarios with
+ * 100k cars can be written and read back with a few bulk reads.
+ */
+class Scenario
+{
+public:
+	std::vector<ScenarioCar> cars;
+	std::vector<ScenarioEvent> events;
+
+	/**
+	 * Generate traffic with random lane changes and acceleration profiles
+	 * @param numCars Number of cars
+	 * @param seed Random seed, equal seeds give equal scenarios
+	 */
+	static Scenario generate(int numCars, unsigned int seed, const ScenarioOptions& options = ScenarioOptions());
+
+	// the three car scene the highway was built around
+	static Scenario highway();
+
+	// binary file: header, cars, events; native byte order
+	bool save(const std::string& file) const;
+	bool load(const std::string& file);
+};
+
+#endif /* SCENARIO_H_ */
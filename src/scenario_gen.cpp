@@ -0,0 +1,23 @@
+// Write a procedurally generated traffic scenario for ukf_highway --scenario
+
+#include <cstdlib>
+#include <iostream>
+#include "scenario.h"
+
+int main(int argc, char** argv)
+{
+	if(argc != 4)
+	{
+		std::cerr << "usage: " << argv[0] << " <cars> <seed> <file>" << std::endl;
+		return 1;
+	}
+
+	Scenario scenario = Scenario::generate(std::atoi(argv[1]), (unsigned int)std::strtoul(argv[2], nullptr, 10));
+	if(!scenario.save(argv[3]))
+	{
+		std::cerr << "Couldn't write scenario to " << argv[3] << std::endl;
+		return 1;
+	}
+	std::cout << scenario.cars.size() << " cars, " << scenario.events.size() << " events" << std::endl;
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include "sensor_pipeline.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+#include "trace.h"
+
+namespace {
+
+// a detection and a track it could belong to
+struct Candidate
+{
+	double distance;
+	int detection;
+	int track;
+
+	bool operator<(const Candidate& other) const
+	{
+		return distance != other.distance ? distance < other.distance : detection != other.detection ? detection < other.detection : track < other.track;
+	}
+};
+
+}
+
+SensorPipeline::SensorPipeline(const SensorPipelineConfig& setConfig, const Completion& completed)
+	: config(setConfig), lidar(std::vector<Car>(), setConfig.detector.groundSlope), detector(setConfig.detector), nextTrack(0),
+	  tracker(setConfig.workers, TrackerRuntime::BY_TRACK_ID)
+{
+	std::vector<Pipeline<SensorFrame>::Stage> stages;
+	stages.push_back([this](SensorFrame& frame) { scan(frame); });
+	stages.push_back([this](SensorFrame& frame) { detect(frame); });
+	stages.push_back([this](SensorFrame& frame) { associate(frame); });
+	stages.push_back([this](SensorFrame& frame) { update(frame); });
+	pipeline.reset(new Pipeline<SensorFrame>(stages, config.maxInFlight, completed));
+}
+
+void SensorPipeline::submit(long long timestamp, const std::vector<Car>& start, const std::vector<Car>& end)
+{
+	SensorFrame frame;
+	frame.timestamp = timestamp;
+	frame.start = start;
+	frame.end = end;
+	pipeline->submit(frame);
+}
+
+void SensorPipeline::scan(SensorFrame& frame)
+{
+	TRACE_SCOPE("SensorPipeline::scan");
+	lidar.scanSweep(frame.start, frame.end, frame.timestamp, config.period_s, frame.sweep);
+}
+
+void SensorPipeline::detect(SensorFrame& frame)
+{
+	TRACE_SCOPE("SensorPipeline::detect");
+	frame.detections = detector.detect(frame.sweep);
+	// the points are not needed past here, free them while later stages run
+	std::vector<SweepPoint>().swap(frame.sweep.points);
+}
+
+void SensorPipeline::associate(SensorFrame& frame)
+{
+	TRACE_SCOPE("SensorPipeline::associate");
+	{
+		std::lock_guard<std::mutex> lock(publishedMutex);
+		for(const TrackSummary& track : published)
+		{
+			std::unordered_map<int, TrackSummary>::iterator gate = gates.find(track.id);
+			if(gate != gates.end())
+			{
+				gate->second.vx = track.vx;
+				gate->second.vy = track.vy;
+			}
+		}
+	}
+
+	long long oldest = frame.timestamp - (long long)(config.dropAfter_s * 1e6);
+	for(std::unordered_map<int, TrackSummary>::iterator gate = gates.begin(); gate != gates.end();)
+	{
+		if(gate->second.timestamp < oldest)
+			gate = gates.erase(gate);
+		else
+			++gate;
+	}
+
+	// greedy nearest neighbor: closest pairs first, each detection and track used once
+	std::vector<Candidate> candidates;
+	for(size_t i = 0; i < frame.detections.size(); i++)
+	{
+		const MeasurementPackage& detection = frame.detections[i];
+		for(const std::pair<const int, TrackSummary>& gate : gates)
+		{
+			const TrackSummary& track = gate.second;
+			double dt = (detection.timestamp_ - track.timestamp) / 1e6;
+			double dx = detection.raw_measurements_(0) - (track.x + track.vx*dt);
+			double dy = detection.raw_measurements_(1) - (track.y + track.vy*dt);
+			double distance = std::sqrt(dx*dx + dy*dy);
+			if(distance <= config.gate)
+				candidates.push_back(Candidate{distance, (int)i, track.id});
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	std::vector<int> assigned(frame.detections.size(), -1);
+	std::unordered_set<int> taken;
+	for(const Candidate& candidate : candidates)
+	{
+		if(assigned[candidate.detection] >= 0 || !taken.insert(candidate.track).second)
+			continue;
+		assigned[candidate.detection] = candidate.track;
+	}
+
+	frame.associated.clear();
+	for(size_t i = 0; i < frame.detections.size(); i++)
+	{
+		const MeasurementPackage& detection = frame.detections[i];
+		int id = assigned[i] >= 0 ? assigned[i] : nextTrack++;
+		TrackSummary& gate = gates[id];
+		if(assigned[i] < 0)
+		{
+			gate.id = id;
+			gate.vx = 0;
+			gate.vy = 0;
+		}
+		gate.x = detection.raw_measurements_(0);
+		gate.y = detection.raw_measurements_(1);
+		gate.timestamp = detection.timestamp_;
+		frame.associated.push_back(Measurement::fromPackage(detection, id));
+	}
+	std::stable_sort(frame.associated.begin(), frame.associated.end(),
+		[](const Measurement& a, const Measurement& b) { return a.timestamp < b.timestamp; });
+}
+
+void SensorPipeline::update(SensorFrame& frame)
+{
+	TRACE_SCOPE("SensorPipeline::update");
+	tracker.process(frame.associated);
+	for(const Measurement& measurement : frame.associated)
+		lastMeasured[measurement.track] = measurement.timestamp;
+
+	long long oldest = frame.timestamp - (long long)(config.dropAfter_s * 1e6);
+	frame.tracks.clear();
+	for(std::unordered_map<int, long long>::iterator it = lastMeasured.begin(); it != lastMeasured.end();)
+	{
+		if(it->second < oldest)
+		{
+			// association dropped its gate for the same age already, so the id never comes back
+			tracker.remove(it->first);
+			it = lastMeasured.erase(it);
+			continue;
+		}
+		const UKF* ukf = tracker.find(it->first);
+		if(ukf && ukf->is_initialized_)
+		{
+			TrackSummary track;
+			track.id = it->first;
+			track.x = ukf->x_(0);
+			track.y = ukf->x_(1);
+			track.vx = ukf->x_(2) * std::cos(ukf->x_(3));
+			track.vy = ukf->x_(2) * std::sin(ukf->x_(3));
+			track.timestamp = ukf->time_us_;
+			frame.tracks.push_back(track);
+		}
+		++it;
+	}
+
+	std::lock_guard<std::mutex> lock(publishedMutex);
+	published = frame.tracks;
+}
@@ -0,0 +1,118 @@
+#ifndef SENSOR_PIPELINE_H_
+#define SENSOR_PIPELINE_H_
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "measurement_queue.h"
+#include "pipeline.h"
+#include "tracker_runtime.h"
+#include "sensors/lidar.h"
+#include "sensors/lidar_detector.h"
+
+// position and velocity of a track in the ego frame
+struct TrackSummary
+{
+	int id;
+	double x, y, vx, vy;
+	// time the state is valid at
+	long long timestamp;
+};
+
+// one lidar sweep on its way through SensorPipeline, each stage fills in its part
+struct SensorFrame
+{
+	long long timestamp;
+	// traffic at the start and the end of the sweep
+	std::vector<Car> start, end;
+	LidarSweep sweep;
+	std::vector<MeasurementPackage> detections;
+	// detections with their track ids, in time order
+	std::vector<Measurement> associated;
+	// tracks measured within dropAfter_s, after the update
+	std::vector<TrackSummary> tracks;
+};
+
+struct SensorPipelineConfig
+{
+	// frames between submit and the end of the update stage
+	int maxInFlight;
+	// TrackerRuntime workers
+	int workers;
+	// time one lidar sweep takes
+	double period_s;
+	// detections farther than this from a predicted track start a new track, meters
+	double gate;
+	// tracks without detections for this long are not associated or reported anymore
+	double dropAfter_s;
+	LidarDetectorConfig detector;
+
+	SensorPipelineConfig()
+		: maxInFlight(3), workers(1), period_s(0.1), gate(3), dropAfter_s(1)
+	{}
+};
+
+/**
+ * Lidar tracking as four pipelined stages, scan -> detect -> associate ->
+ * update, each on its own thread, so the sweep of frame k+1 is cast while
+ * frame k is still being clustered or filtered. Association cannot wait
+ * for the filters of the previous frame without serializing the pipeline,
+ * so it keeps its own gates: each track's last detected position, moved
+ * by the velocity the update stage last published for it. New track ids
+ * are therefore known to association at once, and the filter velocities
+ * lag by at most maxInFlight frames.
+ */
+class SensorPipeline
+{
+public:
+	typedef Pipeline<SensorFrame>::Completion Completion;
+
+	/**
+	 * @param completed Called on the update stage's thread for every frame,
+	 * in order, with its end to end latency
+	 */
+	explicit SensorPipeline(const SensorPipelineConfig& setConfig, const Completion& completed = Completion());
+
+	/**
+	 * Queue one sweep, blocks while maxInFlight frames are in flight
+	 * @param start cars at timestamp
+	 * @param end the same cars one period later
+	 */
+	void submit(long long timestamp, const std::vector<Car>& start, const std::vector<Car>& end);
+
+	// wait for every submitted frame
+	void flush() { pipeline->flush(); }
+
+	// read after flush()
+	const LogHistogram& latency() const { return pipeline->latency; }
+	const LogHistogram& stageTime(int stage) const { return pipeline->stageTime[stage]; }
+
+	const SensorPipelineConfig config;
+
+private:
+	void scan(SensorFrame& frame);
+	void detect(SensorFrame& frame);
+	void associate(SensorFrame& frame);
+	void update(SensorFrame& frame);
+
+	// scan stage
+	Lidar lidar;
+	// detect stage
+	LidarDetector detector;
+	// associate stage
+	std::unordered_map<int, TrackSummary> gates;
+	int nextTrack;
+	// update stage
+	TrackerRuntime tracker;
+	std::unordered_map<int, long long> lastMeasured;
+
+	// velocities from update to associate
+	std::mutex publishedMutex;
+	std::vector<TrackSummary> published;
+
+	// last, so it drains while the stages above still exist
+	std::unique_ptr<Pipeline<SensorFrame> > pipeline;
+};
+
+#endif /* SENSOR_PIPELINE_H_ */
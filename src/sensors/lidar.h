@@ -1,10 +1,21 @@
 #ifndef LIDAR_H
 #define LIDAR_H
 #include "../render/render.h"
+#include "../trace.h"
+#include "../worker_pool.h"
+#include "range_image.h"
+#include <algorithm>
+#include <atomic>
 #include <ctime>
 #include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
 
 const double pi = 3.1415;
+// range image intensities of the two kinds of surfaces in the scene
+const uint16_t kCarIntensity = 200;
+const uint16_t kGroundIntensity = 60;
 
 struct Ray
 {
@@ -27,15 +38,25 @@ struct Ray
 		  castPosition(origin), castDistance(0)
 	{}
 
-	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr)
+	// ray of one beam of a beam table, rays are cheap enough to build per cast
+	Ray(const Vect3& setOrigin, const LidarBeams& beams, int layer, int column, double setResolution)
+		: origin(setOrigin), resolution(setResolution),
+		  direction(resolution*beams.elevationCos[layer]*beams.azimuthCos[column], resolution*beams.elevationCos[layer]*beams.azimuthSin[column], resolution*beams.elevationSin[layer]),
+		  castPosition(origin), castDistance(0)
+	{}
+
+	// march along the ray until it hits the ground or a car, exceeds maxDistance or leaves the road
+	// returns true if the ray stopped at a car
+	bool march(const std::vector<Car>& cars, double maxDistance, double slopeAngle)
 	{
 		// reset ray
 		castPosition = origin;
 		castDistance = 0;
 
 		bool collision = false;
+		bool hitCar = false;
 
-		while(!collision && castDistance < maxDistance && (castPosition.y <= 6 && castPosition.y >= -6 && castPosition.x <= 50 && castPosition.x >= -15))
+		while(!collision && castDistance < maxDistance && onRoad())
 		{
 
 			castPosition = castPosition + direction;
@@ -47,16 +68,34 @@ struct Ray
 			// check if there is any collisions with cars
 			if(!collision && castDistance < maxDistance)
 			{
-				for(Car car : cars)
+				for(const Car& car : cars)
 				{
 					collision |= car.checkCollision(castPosition);
 					if(collision)
 						break;
 				}
+				hitCar = collision;
 			}
 		}
+		return hitCar;
+	}
+
+	bool onRoad() const
+	{
+		return castPosition.y <= 6 && castPosition.y >= -6 && castPosition.x <= 50 && castPosition.x >= -15;
+	}
+
+	// whether the last march produced a return
+	bool returned(double minDistance, double maxDistance) const
+	{
+		return (castDistance >= minDistance)&&(castDistance<=maxDistance)&& onRoad();
+	}
+
+	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr)
+	{
+		march(cars, maxDistance, slopeAngle);
 
-		if((castDistance >= minDistance)&&(castDistance<=maxDistance)&& (castPosition.y <= 6 && castPosition.y >= -6 && castPosition.x <= 50 && castPosition.x >= -15))
+		if(returned(minDistance, maxDistance))
 		{
 			// add noise based on standard deviation error
 			double rx = ((double) rand() / (RAND_MAX));
@@ -69,10 +108,95 @@ struct Ray
 
 };
 
+// the collision box of Car at one instant of a sweep, cheap to interpolate and copy
+struct CarBox
+{
+	Vect3 position, dimensions;
+	double sinNegTheta, cosNegTheta;
+	// bounding circle on the road plane
+	double radius;
+
+	/**
+	 * Pose of a car a fraction of the way between two frames
+	 * @param s 0 for the pose of start, 1 for the pose of end
+	 */
+	CarBox(const Car& start, const Car& end, double s)
+		: position(start.position.x + s*(end.position.x - start.position.x), start.position.y + s*(end.position.y - start.position.y), start.position.z),
+		  dimensions(start.dimensions),
+		  radius(sqrt(start.dimensions.x*start.dimensions.x + start.dimensions.y*start.dimensions.y) / 2)
+	{
+		double angle = start.angle + s*(end.angle - start.angle);
+		sinNegTheta = sin(-angle);
+		cosNegTheta = cos(-angle);
+	}
+
+	bool inbetween(double point, double center, double range) const
+	{
+		return (center - range <= point) && (center + range >= point);
+	}
+
+	// same test as Car::checkCollision
+	bool checkCollision(const Vect3& point) const
+	{
+		double xPrime = ((point.x-position.x) * cosNegTheta - (point.y-position.y) * sinNegTheta)+position.x;
+		double yPrime = ((point.y-position.y) * cosNegTheta + (point.x-position.x) * sinNegTheta)+position.y;
+
+		return (inbetween(xPrime, position.x, dimensions.x / 2) && inbetween(yPrime, position.y, dimensions.y / 2) && inbetween(point.z, position.z + dimensions.z / 3, dimensions.z / 3)) ||
+			(inbetween(xPrime, position.x, dimensions.x / 4) && inbetween(yPrime, position.y, dimensions.y / 2) && inbetween(point.z, position.z + dimensions.z * 5 / 6, dimensions.z / 6));
+	}
+};
+
+// a return of a sweep, 16 bytes
+struct SweepPoint
+{
+	float x, y, z;
+	// time of the return after the start of the sweep
+	uint32_t offset_us;
+};
+
+// one revolution of a rolling shutter lidar
+struct LidarSweep
+{
+	long long timestamp_us;
+	// ordered by column, so by time
+	std::vector<SweepPoint> points;
+};
+
+// what a ray hit in the last scan, enough to rebuild its return
+enum RayHitKind { kNoReturn, kGroundReturn, kCarReturn };
+
+struct RayHit
+{
+	// number of ray steps to the return
+	uint16_t steps;
+	uint8_t kind;
+};
+
+// bounding circle and orientation of a car as of the last scan
+struct CarFootprint
+{
+	double x, y, cosNegTheta, sinNegTheta, radius;
+
+	CarFootprint()
+		: x(0), y(0), cosNegTheta(1), sinNegTheta(0), radius(0)
+	{}
+
+	explicit CarFootprint(const Car& car)
+		: x(car.position.x), y(car.position.y), cosNegTheta(car.cosNegTheta), sinNegTheta(car.sinNegTheta),
+		  radius(sqrt(car.dimensions.x*car.dimensions.x + car.dimensions.y*car.dimensions.y) / 2)
+	{}
+
+	bool operator==(const CarFootprint& other) const
+	{
+		return x == other.x && y == other.y && cosNegTheta == other.cosNegTheta && sinNegTheta == other.sinNegTheta && radius == other.radius;
+	}
+};
+
 struct Lidar
 {
 
-	std::vector<Ray> rays;
+	// beam angles, shared by all lidars and range images of the same configuration
+	std::shared_ptr<const LidarBeams> beams;
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
 	std::vector<Car> cars;
 	Vect3 position;
@@ -82,8 +206,20 @@ struct Lidar
 	double resoultion;
 	double sderr;
 
+	// incremental scan state: hit per ray, layer-major, and the car footprints it was cast against
+	std::vector<RayHit> hitCache;
+	std::vector<CarFootprint> footprints;
+	std::vector<uint8_t> dirtyColumns;
+	// rays cast by the last scanIncremental
+	int raysCast;
+	// scanSweep: azimuth sectors processed as one time slice, and worker threads, 0 for one per core
+	int sweepSectors;
+	int sweepThreads;
+	// scanSweep's threads, started on the first sweep and parked between sweeps; copies of the lidar share them
+	std::shared_ptr<WorkerPool> sweepWorkers;
+
 	Lidar(std::vector<Car> setCars, double setGroundSlope)
-		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,3.0)
+		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,3.0), raysCast(0), sweepSectors(90), sweepThreads(0)
 	{
 		// TODO:: set minDistance to 5 to remove points from roof of ego car
 		minDistance = 0;
@@ -94,24 +230,22 @@ struct Lidar
 		cars = setCars;
 		groundSlope = setGroundSlope;
 
+		beams = defaultBeams();
+	}
+
+	// the beam table of the default configuration, built on first use
+	static std::shared_ptr<const LidarBeams> defaultBeams()
+	{
 		// TODO:: increase number of layers to 8 to get higher resoultion pcd
-		int numLayers = 64;
+		const int numLayers = 64;
 		// the steepest vertical angle
-		double steepestAngle =  24.8*(-pi/180);
-		double angleRange = 26.8*(pi/180);
-		// TODO:: set to pi/64 to get higher resoultion pcd
-		double horizontalAngleInc = pi/2250;
+		const double steepestAngle =  24.8*(-pi/180);
+		const double angleRange = 26.8*(pi/180);
+		// TODO:: set to 128 to get higher resoultion pcd
+		const int numColumns = 4500;
 
-		double angleIncrement = angleRange/numLayers;
-
-		for(double angleVertical = steepestAngle; angleVertical < steepestAngle+angleRange; angleVertical+=angleIncrement)
-		{
-			for(double angle = 0; angle <= 2*pi; angle+=horizontalAngleInc)
-			{
-				Ray ray(position,angle,angleVertical,resoultion);
-				rays.push_back(ray);
-			}
-		}
+		static const std::shared_ptr<const LidarBeams> beams = LidarBeams::spinning(numLayers, steepestAngle, angleRange, numColumns, 2*pi);
+		return beams;
 	}
 
 	~Lidar()
@@ -126,19 +260,303 @@ struct Lidar
 
 	pcl::PointCloud<pcl::PointXYZ>::Ptr scan()
 	{
- 
+		TRACE_SCOPE("Lidar::scan");
 		cloud->points.clear();
-		auto startTime = std::chrono::steady_clock::now();
-		for(Ray ray : rays)
-			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
-		auto endTime = std::chrono::steady_clock::now();
-		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
+		for(int layer = 0; layer < beams->layers(); layer++)
+		{
+			for(int column = 0; column < beams->columns(); column++)
+			{
+				Ray ray(position, *beams, layer, column, resoultion);
+				ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
+			}
+		}
 		cloud->width = cloud->points.size();
 		cloud->height = 1; // one dimensional unorganized point cloud dataset
 		return cloud;
 	}
 
+	/**
+	 * Scan into an organized range image, one cell per ray. The range gets
+	 * the same uniform noise as the points of scan().
+	 */
+	void scanOrganized(RangeImage& image)
+	{
+		TRACE_SCOPE("Lidar::scanOrganized");
+		image.reset(beams, position.x, position.y, position.z);
+		for(int layer = 0; layer < beams->layers(); layer++)
+		{
+			for(int column = 0; column < beams->columns(); column++)
+			{
+				Ray ray(position, *beams, layer, column, resoultion);
+				bool hitCar = ray.march(cars, maxDistance, groundSlope);
+				if(ray.returned(minDistance, maxDistance))
+				{
+					double noise = ((double) rand() / (RAND_MAX)) * sderr;
+					image.set(layer, column, ray.castDistance + noise, hitCar ? kCarIntensity : kGroundIntensity);
+				}
+			}
+		}
+	}
+
+	// forget the cached hits, needed after changing position, groundSlope or the distance limits
+	void invalidateScanCache()
+	{
+		hitCache.clear();
+	}
+
+	/**
+	 * Same returns as scan(), but rays are only cast again where a car
+	 * moved since the previous call: the columns whose azimuth overlaps the
+	 * car's previous or current bounding circle. Every other ray keeps its
+	 * cached hit and only gets fresh noise, so the cost of a frame follows
+	 * the moving cars rather than the ray count. The first call, and any
+	 * call after the number of cars changed, casts every ray.
+	 */
+	pcl::PointCloud<pcl::PointXYZ>::Ptr scanIncremental()
+	{
+		TRACE_SCOPE("Lidar::scanIncremental");
+		const int layers = beams->layers();
+		const int columns = beams->columns();
+
+		bool full = hitCache.empty() || footprints.size() != cars.size();
+		dirtyColumns.assign(columns, full);
+		if(full)
+		{
+			hitCache.assign((size_t)layers * columns, RayHit{0, kNoReturn});
+			footprints.assign(cars.size(), CarFootprint());
+		}
+		for(size_t i = 0; i < cars.size(); i++)
+		{
+			CarFootprint current(cars[i]);
+			if(current == footprints[i])
+				continue;
+			if(!full)
+			{
+				markSector(footprints[i]);
+				markSector(current);
+			}
+			footprints[i] = current;
+		}
+
+		raysCast = 0;
+		for(int column = 0; column < columns; column++)
+		{
+			if(!dirtyColumns[column])
+				continue;
+			for(int layer = 0; layer < layers; layer++)
+			{
+				Ray ray(position, *beams, layer, column, resoultion);
+				bool hitCar = ray.march(cars, maxDistance, groundSlope);
+				RayHit& hit = hitCache[(size_t)layer * columns + column];
+				hit.steps = (uint16_t)std::lround(ray.castDistance / resoultion);
+				hit.kind = !ray.returned(minDistance, maxDistance) ? kNoReturn : hitCar ? kCarReturn : kGroundReturn;
+			}
+			raysCast += layers;
+		}
+
+		cloud->points.clear();
+		for(int layer = 0; layer < layers; layer++)
+		{
+			for(int column = 0; column < columns; column++)
+			{
+				const RayHit& hit = hitCache[(size_t)layer * columns + column];
+				if(hit.kind == kNoReturn)
+					continue;
+				Ray ray(position, *beams, layer, column, resoultion);
+				double rx = ((double) rand() / (RAND_MAX));
+				double ry = ((double) rand() / (RAND_MAX));
+				double rz = ((double) rand() / (RAND_MAX));
+				cloud->points.push_back(pcl::PointXYZ(position.x + hit.steps*ray.direction.x + rx*sderr,
+					position.y + hit.steps*ray.direction.y + ry*sderr,
+					position.z + hit.steps*ray.direction.z + rz*sderr));
+			}
+		}
+		cloud->width = cloud->points.size();
+		cloud->height = 1;
+		return cloud;
+	}
+
+	/**
+	 * Rolling shutter scan: the beams turn once over the period, so column c
+	 * fires at timestamp + c/columns * period. The sweep is cut into
+	 * sweepSectors azimuth sectors, each cast on one of sweepWorkers against the
+	 * cars interpolated to the middle of its time slice between the start
+	 * and end poses. Points carry their column's time.
+	 * @param start cars at timestamp_us
+	 * @param end the same cars one period later
+	 */
+	void scanSweep(const std::vector<Car>& start, const std::vector<Car>& end, long long timestamp_us, double period_s, LidarSweep& sweep)
+	{
+		TRACE_SCOPE("Lidar::scanSweep");
+		const int columns = beams->columns();
+		const int sectors = std::max(1, std::min(sweepSectors, columns));
+		std::vector<std::vector<SweepPoint> > sectorPoints(sectors);
+		std::atomic<int> next(0);
+
+		auto worker = [&]()
+		{
+			std::vector<CarBox> boxes;
+			std::vector<int> candidates;
+			for(int sector = next++; sector < sectors; sector = next++)
+			{
+				int firstColumn = sector * columns / sectors;
+				int endColumn = (sector + 1) * columns / sectors;
+				double s = (firstColumn + endColumn) * 0.5 / columns;
+				boxes.clear();
+				for(size_t i = 0; i < start.size() && i < end.size(); i++)
+					boxes.push_back(CarBox(start[i], end[i], s));
+
+				// noise streams per sweep and sector, independent of the thread schedule
+				std::minstd_rand generator((uint32_t)(timestamp_us * 131 + sector + 1));
+				std::uniform_real_distribution<double> unit(0, 1);
+				std::vector<SweepPoint>& points = sectorPoints[sector];
+				for(int column = firstColumn; column < endColumn; column++)
+				{
+					sectorCandidates(boxes, column, candidates);
+					uint32_t offset_us = (uint32_t)(1e6 * period_s * column / columns);
+					for(int layer = 0; layer < beams->layers(); layer++)
+					{
+						Vect3 hit(0, 0, 0);
+						if(!castCulled(boxes, candidates, layer, column, hit))
+							continue;
+						SweepPoint point;
+						point.x = hit.x + unit(generator)*sderr;
+						point.y = hit.y + unit(generator)*sderr;
+						point.z = hit.z + unit(generator)*sderr;
+						point.offset_us = offset_us;
+						points.push_back(point);
+					}
+				}
+			}
+		};
+
+		int numThreads = sweepThreads > 0 ? sweepThreads : std::max(1u, std::thread::hardware_concurrency());
+		if(numThreads == 1)
+			worker();
+		else
+		{
+			if(!sweepWorkers || sweepWorkers->threads() != numThreads)
+				sweepWorkers = std::make_shared<WorkerPool>(numThreads);
+			sweepWorkers->run(worker);
+		}
+
+		sweep.timestamp_us = timestamp_us;
+		sweep.points.clear();
+		for(const std::vector<SweepPoint>& points : sectorPoints)
+			sweep.points.insert(sweep.points.end(), points.begin(), points.end());
+	}
+
+	// indices of the boxes whose bounding circle the column's rays can pass through
+	void sectorCandidates(const std::vector<CarBox>& boxes, int column, std::vector<int>& candidates) const
+	{
+		candidates.clear();
+		double azimuth = atan2(beams->azimuthSin[column], beams->azimuthCos[column]);
+		for(size_t i = 0; i < boxes.size(); i++)
+		{
+			double dx = boxes[i].position.x - position.x;
+			double dy = boxes[i].position.y - position.y;
+			double distance = sqrt(dx*dx + dy*dy);
+			if(distance <= boxes[i].radius)
+			{
+				candidates.push_back(i);
+				continue;
+			}
+			double difference = std::fabs(std::remainder(azimuth - atan2(dy, dx), 2*M_PI));
+			if(difference <= asin(boxes[i].radius / distance) + beams->azimuthIncrement)
+				candidates.push_back(i);
+		}
+	}
+
+	/**
+	 * Ray::march with the ground, range and road limits solved in closed
+	 * form, so only the steps that can reach a candidate box are walked
+	 * @return true with the return position in hit if the ray returned
+	 */
+	bool castCulled(const std::vector<CarBox>& boxes, const std::vector<int>& candidates, int layer, int column, Vect3& hit) const
+	{
+		Ray ray(position, *beams, layer, column, resoultion);
+		const Vect3& o = ray.origin;
+		const Vect3& d = ray.direction;
+		const double tanSlope = tan(groundSlope);
+
+		// first step k >= 1 at which each limit stops the march
+		long long end = (long long)std::ceil(maxDistance / resoultion);
+		double groundStart = o.z - o.x * tanSlope;
+		double groundRate = d.z - d.x * tanSlope;
+		long long groundStep = end + 1;
+		if(groundStart + groundRate <= 0)
+			groundStep = 1;
+		else if(groundRate < 0)
+			groundStep = (long long)std::ceil(groundStart / -groundRate);
+		end = std::min(end, groundStep);
+		end = std::min(end, exitStep(o.y, d.y, -6, 6));
+		end = std::min(end, exitStep(o.x, d.x, -15, 50));
+
+		double horizontalStep = sqrt(d.x*d.x + d.y*d.y);
+		for(int i : candidates)
+		{
+			const CarBox& box = boxes[i];
+			double dx = box.position.x - o.x;
+			double dy = box.position.y - o.y;
+			double distance = sqrt(dx*dx + dy*dy);
+			long long first = 1, last = end - 1;
+			if(horizontalStep > 0)
+			{
+				first = std::max(first, (long long)std::floor((distance - box.radius) / horizontalStep));
+				last = std::min(last, (long long)std::ceil((distance + box.radius) / horizontalStep));
+			}
+			for(long long k = first; k <= last; k++)
+			{
+				if(box.checkCollision(Vect3(o.x + k*d.x, o.y + k*d.y, o.z + k*d.z)))
+				{
+					end = k;
+					break;
+				}
+			}
+		}
+
+		hit = Vect3(o.x + end*d.x, o.y + end*d.y, o.z + end*d.z);
+		double distance = end * resoultion;
+		bool onRoad = hit.y <= 6 && hit.y >= -6 && hit.x <= 50 && hit.x >= -15;
+		return distance >= minDistance && distance <= maxDistance && onRoad;
+	}
+
+	// first step k >= 1 at which start + k*rate leaves [low, high]
+	static long long exitStep(double start, double rate, double low, double high)
+	{
+		if(rate > 0)
+			return (long long)std::floor((high - start) / rate) + 1;
+		if(rate < 0)
+			return (long long)std::floor((start - low) / -rate) + 1;
+		return std::numeric_limits<long long>::max();
+	}
+
+	// mark the columns whose rays can pass through the footprint's bounding circle
+	void markSector(const CarFootprint& footprint)
+	{
+		const int columns = beams->columns();
+		double dx = footprint.x - position.x;
+		double dy = footprint.y - position.y;
+		double distance = sqrt(dx*dx + dy*dy);
+		if(distance <= footprint.radius || beams->azimuthIncrement <= 0)
+		{
+			dirtyColumns.assign(columns, 1);
+			return;
+		}
+		double center = atan2(dy, dx);
+		double halfWidth = asin(footprint.radius / distance);
+		// one column of margin for rounding and the seam of the sweep
+		int first = (int)std::floor((center - halfWidth) / beams->azimuthIncrement) - 1;
+		int last = (int)std::ceil((center + halfWidth) / beams->azimuthIncrement) + 1;
+		if(last - first >= columns)
+		{
+			dirtyColumns.assign(columns, 1);
+			return;
+		}
+		for(int column = first; column <= last; column++)
+			dirtyColumns[(column % columns + columns) % columns] = 1;
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,284 @@
+/* Turns lidar point clouds into position measurements of the cars */
+
+#include "lidar_detector.h"
+#include "../trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// grid coordinates are biased into unsigned fields of the keys
+const int64_t voxelBias = 1 << 20;
+const uint64_t voxelMask = (1 << 21) - 1;
+const int64_t cellBias = 1LL << 31;
+
+uint64_t voxelKey(int64_t ix, int64_t iy, int64_t iz)
+{
+	return ((uint64_t)(ix + voxelBias) & voxelMask) << 42 | ((uint64_t)(iy + voxelBias) & voxelMask) << 21 | ((uint64_t)(iz + voxelBias) & voxelMask);
+}
+
+uint64_t cellKey(int64_t cx, int64_t cy)
+{
+	return (uint64_t)(cx + cellBias) << 32 | (uint32_t)(cy + cellBias);
+}
+
+}
+
+LidarDetector::LidarDetector(const LidarDetectorConfig& setConfig)
+	: config(setConfig)
+{}
+
+std::vector<MeasurementPackage> LidarDetector::detect(const pcl::PointCloud<pcl::PointXYZ>& cloud, long long timestamp)
+{
+	TRACE_SCOPE("LidarDetector::detect");
+	if(cloud.points.empty())
+		run(nullptr, sizeof(pcl::PointXYZ), 0, -1, timestamp);
+	else
+		run(reinterpret_cast<const char*>(&cloud.points[0]), sizeof(pcl::PointXYZ), cloud.points.size(), -1, timestamp);
+	return measurements();
+}
+
+std::vector<MeasurementPackage> LidarDetector::detect(const LidarSweep& sweep)
+{
+	TRACE_SCOPE("LidarDetector::detect");
+	if(sweep.points.empty())
+		run(nullptr, sizeof(SweepPoint), 0, -1, sweep.timestamp_us);
+	else
+		run(reinterpret_cast<const char*>(&sweep.points[0]), sizeof(SweepPoint), sweep.points.size(), offsetof(SweepPoint, offset_us), sweep.timestamp_us);
+	return measurements();
+}
+
+void LidarDetector::run(const char* data, size_t stride, size_t count, ptrdiff_t timeField, long long timestamp)
+{
+	// ground removal and voxel keys are per point, split them over the workers
+	int numThreads = config.threads > 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+	// not worth a thread below a few thousand points
+	numThreads = (int)std::max<size_t>(1, std::min<size_t>(numThreads, count / 4096));
+	chunks.resize(numThreads);
+	{
+		TRACE_SCOPE("LidarDetector::downsample");
+		std::vector<std::thread> threads;
+		for(int t = 1; t < numThreads; t++)
+			threads.push_back(std::thread(&LidarDetector::downsample, this, data, stride, count * t / numThreads, count * (t + 1) / numThreads, timeField, std::ref(chunks[t])));
+		downsample(data, stride, 0, count / numThreads, timeField, chunks[0]);
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+
+	points.clear();
+	for(const std::vector<VoxelPoint>& chunk : chunks)
+		points.insert(points.end(), chunk.begin(), chunk.end());
+	buildVoxels();
+	clusterVoxels(timestamp);
+}
+
+void LidarDetector::downsample(const char* data, size_t stride, size_t begin, size_t end, ptrdiff_t timeField, std::vector<VoxelPoint>& out) const
+{
+	out.clear();
+	const double tanSlope = tan(config.groundSlope);
+	const float inverseVoxel = 1.0f / config.voxelSize;
+	for(size_t i = begin; i < end; i++)
+	{
+		const char* point = data + i * stride;
+		float xyz[3];
+		std::memcpy(xyz, point, sizeof(xyz));
+		if(!std::isfinite(xyz[0]) || !std::isfinite(xyz[1]) || !std::isfinite(xyz[2]))
+			continue;
+		if(xyz[2] - xyz[0] * tanSlope <= config.groundTolerance)
+			continue;
+
+		VoxelPoint voxelPoint;
+		voxelPoint.key = voxelKey((int64_t)std::floor(xyz[0] * inverseVoxel), (int64_t)std::floor(xyz[1] * inverseVoxel), (int64_t)std::floor(xyz[2] * inverseVoxel));
+		voxelPoint.x = xyz[0];
+		voxelPoint.y = xyz[1];
+		voxelPoint.z = xyz[2];
+		voxelPoint.offset_us = 0;
+		if(timeField >= 0)
+			std::memcpy(&voxelPoint.offset_us, point + timeField, sizeof(uint32_t));
+		out.push_back(voxelPoint);
+	}
+}
+
+void LidarDetector::buildVoxels()
+{
+	TRACE_SCOPE("LidarDetector::buildVoxels");
+	std::sort(points.begin(), points.end(), [](const VoxelPoint& a, const VoxelPoint& b) { return a.key < b.key; });
+
+	// one voxel per run of equal keys, at the centroid of its points
+	voxels.clear();
+	const float inverseCell = 1.0f / config.clusterTolerance;
+	for(size_t begin = 0, end = 0; begin < points.size(); begin = end)
+	{
+		double x = 0, y = 0, z = 0, offset = 0;
+		for(end = begin; end < points.size() && points[end].key == points[begin].key; end++)
+		{
+			x += points[end].x;
+			y += points[end].y;
+			z += points[end].z;
+			offset += points[end].offset_us;
+		}
+		int n = (int)(end - begin);
+		Voxel voxel;
+		voxel.x = x / n;
+		voxel.y = y / n;
+		voxel.z = z / n;
+		voxel.offset_us = offset;
+		voxel.points = n;
+		voxel.cell = cellKey((int64_t)std::floor(voxel.x * inverseCell), (int64_t)std::floor(voxel.y * inverseCell));
+		voxels.push_back(voxel);
+	}
+
+	byCell.resize(voxels.size());
+	for(size_t i = 0; i < voxels.size(); i++)
+		byCell[i] = i;
+	std::sort(byCell.begin(), byCell.end(), [this](int a, int b) { return voxels[a].cell < voxels[b].cell; });
+	cellStart.clear();
+	for(size_t i = 0; i < byCell.size(); i++)
+		if(i == 0 || voxels[byCell[i]].cell != voxels[byCell[i-1]].cell)
+			cellStart.push_back(i);
+	cellStart.push_back(byCell.size());
+}
+
+int LidarDetector::find(int voxel)
+{
+	while(parent[voxel] != voxel)
+	{
+		parent[voxel] = parent[parent[voxel]];
+		voxel = parent[voxel];
+	}
+	return voxel;
+}
+
+void LidarDetector::clusterVoxels(long long timestamp)
+{
+	TRACE_SCOPE("LidarDetector::clusterVoxels");
+	parent.resize(voxels.size());
+	for(size_t i = 0; i < voxels.size(); i++)
+		parent[i] = i;
+
+	const float tolerance2 = config.clusterTolerance * config.clusterTolerance;
+	const int numCells = (int)cellStart.size() - 1;
+	for(int cell = 0; cell < numCells; cell++)
+	{
+		uint64_t key = voxels[byCell[cellStart[cell]]].cell;
+		// cells within one cell of this one; each pair of cells is visited once
+		for(int dx = -1; dx <= 1; dx++)
+		{
+			for(int dy = -1; dy <= 1; dy++)
+			{
+				uint64_t neighborKey = key + ((uint64_t)(int64_t)dx << 32) + (uint64_t)(int64_t)dy;
+				if(neighborKey < key)
+					continue;
+				int neighbor = cell;
+				if(neighborKey != key)
+				{
+					std::vector<int>::const_iterator it = std::lower_bound(cellStart.begin() + cell + 1, cellStart.end() - 1, neighborKey,
+						[this](int start, uint64_t value) { return voxels[byCell[start]].cell < value; });
+					if(it == cellStart.end() - 1 || voxels[byCell[*it]].cell != neighborKey)
+						continue;
+					neighbor = (int)(it - cellStart.begin());
+				}
+
+				for(int i = cellStart[cell]; i < cellStart[cell+1]; i++)
+				{
+					const Voxel& a = voxels[byCell[i]];
+					int first = neighbor == cell ? i + 1 : cellStart[neighbor];
+					for(int j = first; j < cellStart[neighbor+1]; j++)
+					{
+						const Voxel& b = voxels[byCell[j]];
+						float ex = a.x - b.x;
+						float ey = a.y - b.y;
+						if(ex*ex + ey*ey > tolerance2)
+							continue;
+						int rootA = find(byCell[i]);
+						int rootB = find(byCell[j]);
+						if(rootA != rootB)
+							parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+					}
+				}
+			}
+		}
+	}
+
+	// accumulate every cluster at its root, the lowest voxel index of the cluster
+	sums.assign(voxels.size(), LidarCluster());
+	offsets.assign(voxels.size(), 0);
+	bounds.resize(4 * voxels.size());
+	for(size_t i = 0; i < voxels.size(); i++)
+	{
+		int root = find(i);
+		const Voxel& voxel = voxels[i];
+		float* extent = &bounds[4 * root];
+		if(root == (int)i)
+		{
+			extent[0] = extent[1] = voxel.x;
+			extent[2] = extent[3] = voxel.y;
+		}
+		extent[0] = std::min(extent[0], voxel.x);
+		extent[1] = std::max(extent[1], voxel.x);
+		extent[2] = std::min(extent[2], voxel.y);
+		extent[3] = std::max(extent[3], voxel.y);
+		LidarCluster& sum = sums[root];
+		sum.x += voxel.x * voxel.points;
+		sum.y += voxel.y * voxel.points;
+		sum.z += voxel.z * voxel.points;
+		sum.points += voxel.points;
+		sum.voxels++;
+		offsets[root] += voxel.offset_us;
+	}
+
+	found.clear();
+	for(size_t i = 0; i < voxels.size(); i++)
+	{
+		if(find(i) != (int)i)
+			continue;
+		LidarCluster cluster = sums[i];
+		if(cluster.points < config.minClusterPoints || cluster.points > config.maxClusterPoints)
+			continue;
+		cluster.x /= cluster.points;
+		cluster.y /= cluster.points;
+		cluster.z /= cluster.points;
+		if(config.objectLength > 0 && config.objectWidth > 0)
+		{
+			const float* extent = &bounds[4 * i];
+			cluster.x = center(extent[0], extent[1], config.objectLength);
+			cluster.y = center(extent[2], extent[3], config.objectWidth);
+		}
+		cluster.timestamp = timestamp + std::llround(offsets[i] / cluster.points);
+		found.push_back(cluster);
+	}
+}
+
+/**
+ * Middle of an object of the given size seen over [low, high] along one
+ * axis from the origin. Only the near end of a short extent is real, the
+ * far one was hidden behind the object.
+ */
+float LidarDetector::center(float low, float high, float size)
+{
+	if(high - low < size)
+	{
+		if(low >= 0)
+			high = low + size;
+		else if(high <= 0)
+			low = high - size;
+	}
+	return (low + high) / 2;
+}
+
+std::vector<MeasurementPackage> LidarDetector::measurements() const
+{
+	std::vector<MeasurementPackage> packages;
+	for(const LidarCluster& cluster : found)
+	{
+		MeasurementPackage package;
+		package.sensor_type_ = MeasurementPackage::LASER;
+		package.raw_measurements_ = Eigen::VectorXd(2);
+		package.raw_measurements_ << cluster.x, cluster.y;
+		package.timestamp_ = cluster.timestamp;
+		packages.push_back(package);
+	}
+	return packages;
+}
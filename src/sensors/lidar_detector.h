@@ -0,0 +1,110 @@
+/* Turns lidar point clouds into position measurements of the cars */
+
+#ifndef LIDAR_DETECTOR_H
+#define LIDAR_DETECTOR_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "lidar.h"
+#include "../measurement_package.h"
+
+struct LidarDetectorConfig
+{
+	// edge of the downsampling voxels, meters
+	float voxelSize;
+	// slope of the road, as passed to Lidar
+	double groundSlope;
+	// points up to this height above the road are ground
+	float groundTolerance;
+	// voxels closer than this on the road plane belong to the same object
+	float clusterTolerance;
+	// clusters outside these point counts are dropped as clutter or as not a car
+	int minClusterPoints;
+	int maxClusterPoints;
+	// footprint of the cars along x and y, meters; a cluster shorter than that is extended away from the
+	// lidar at the origin, since only the faces turned towards it return points. 0 reports the centroid
+	float objectLength;
+	float objectWidth;
+	// worker threads for downsampling, 0 for one per core
+	int threads;
+
+	LidarDetectorConfig()
+		: voxelSize(0.2f), groundSlope(0), groundTolerance(0.2f), clusterTolerance(1.0f),
+		  minClusterPoints(10), maxClusterPoints(20000), objectLength(4), objectWidth(2), threads(0)
+	{}
+};
+
+// one object found in a cloud
+struct LidarCluster
+{
+	// center of the object on the road plane, and the centroid height of the points
+	float x, y, z;
+	int points;
+	int voxels;
+	long long timestamp;
+};
+
+/**
+ * Detection front end: ground removal against the known road slope, voxel
+ * downsampling, then Euclidean clustering of the voxels on a uniform grid
+ * of clusterTolerance cells, where only the 3x3 neighboring cells need to be
+ * searched. Every array is sorted and reused between frames, so a frame
+ * allocates nothing once the buffers have grown. Each cluster becomes a
+ * LASER MeasurementPackage at its centroid.
+ */
+class LidarDetector
+{
+public:
+
+	explicit LidarDetector(const LidarDetectorConfig& setConfig = LidarDetectorConfig());
+
+	std::vector<MeasurementPackage> detect(const pcl::PointCloud<pcl::PointXYZ>& cloud, long long timestamp);
+	// clusters of a rolling shutter sweep are stamped with the mean time of their points
+	std::vector<MeasurementPackage> detect(const LidarSweep& sweep);
+
+	// clusters of the last detect
+	const std::vector<LidarCluster>& clusters() const { return found; }
+
+	LidarDetectorConfig config;
+
+private:
+
+	struct VoxelPoint
+	{
+		uint64_t key;
+		float x, y, z;
+		uint32_t offset_us;
+	};
+
+	struct Voxel
+	{
+		float x, y, z;
+		double offset_us;
+		int points;
+		uint64_t cell;
+	};
+
+	// points as x, y, z floats at the start of every stride bytes, with an optional time field
+	void run(const char* data, size_t stride, size_t count, ptrdiff_t timeField, long long timestamp);
+	void downsample(const char* data, size_t stride, size_t begin, size_t end, ptrdiff_t timeField, std::vector<VoxelPoint>& out) const;
+	void buildVoxels();
+	void clusterVoxels(long long timestamp);
+	int find(int voxel);
+	static float center(float low, float high, float size);
+	std::vector<MeasurementPackage> measurements() const;
+
+	std::vector<std::vector<VoxelPoint> > chunks;
+	std::vector<VoxelPoint> points;
+	std::vector<Voxel> voxels;
+	// voxel indices ordered by grid cell, and the first entry of each distinct cell
+	std::vector<int> byCell;
+	std::vector<int> cellStart;
+	std::vector<int> parent;
+	std::vector<LidarCluster> sums;
+	std::vector<double> offsets;
+	// road plane extent of every cluster at its root: min x, max x, min y, max y
+	std::vector<float> bounds;
+	std::vector<LidarCluster> found;
+};
+
+#endif
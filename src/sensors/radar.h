@@ -0,0 +1,199 @@
+#ifndef RADAR_H
+#define RADAR_H
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../kinematics.h"
+#include "../measurement_package.h"
+
+struct RadarConfig
+{
+	// returns only within +-fov of the boresight, radians
+	float fov;
+	float minRange, maxRange;
+	// measurement noise, as Tools::radarSense
+	float stdRho, stdPhi, stdRhoDot;
+	// chance that a car in the field of view gives a return
+	float detectionProbability;
+	// expected false alarms per meter and radian of the field of view
+	float clutterDensity;
+	// false alarm range rates are uniform within +-clutterMaxSpeed
+	float clutterMaxSpeed;
+
+	RadarConfig()
+		: fov(M_PI), minRange(0.5f), maxRange(100), stdRho(0.3f), stdPhi(0.03f), stdRhoDot(0.3f),
+		  detectionProbability(1), clutterDensity(0), clutterMaxSpeed(30)
+	{}
+};
+
+// position, heading and velocity of the vehicle carrying the radar
+struct RadarPose
+{
+	double x, y;
+	float yaw, vx, vy;
+};
+
+/**
+ * One scan worth of returns as a structure of arrays, one entry per
+ * return, so a filter can take the whole batch at once. Ranges and range
+ * rates are relative to the radar's pose, bearings to its boresight.
+ */
+struct RadarReturns
+{
+	long long timestamp;
+	// where the radar was and how it moved during the scan
+	RadarPose pose;
+	std::vector<float> rho, phi, rhoDot;
+	// index of the car that caused the return, -1 for clutter
+	std::vector<int> target;
+
+	size_t size() const { return rho.size(); }
+
+	void clear()
+	{
+		rho.clear();
+		phi.clear();
+		rhoDot.clear();
+		target.clear();
+	}
+
+	void push(float setRho, float setPhi, float setRhoDot, int setTarget)
+	{
+		rho.push_back(setRho);
+		phi.push_back(setPhi);
+		rhoDot.push_back(setRhoDot);
+		target.push_back(setTarget);
+	}
+
+	/**
+	 * Return i as a world frame measurement for RadarModel: the bearing is
+	 * turned by the radar's yaw, as FrameSet::toWorldFrame does, and the
+	 * package carries the radar's position and velocity
+	 */
+	MeasurementPackage package(size_t i) const
+	{
+		MeasurementPackage meas_package;
+		meas_package.sensor_type_ = MeasurementPackage::RADAR;
+		meas_package.raw_measurements_ = Eigen::VectorXd(3);
+		// RadarModel normalizes the bearing residual, no need to wrap here
+		meas_package.raw_measurements_ << rho[i], phi[i] + pose.yaw, rhoDot[i];
+		meas_package.timestamp_ = timestamp;
+		meas_package.sensor_x_ = pose.x;
+		meas_package.sensor_y_ = pose.y;
+		meas_package.sensor_vx_ = pose.vx;
+		meas_package.sensor_vy_ = pose.vy;
+		return meas_package;
+	}
+};
+
+/**
+ * Multi target radar: every car of a KinematicsWorld within range and
+ * field of view is measured in one pass over the world's arrays, then
+ * dropped with the miss probability, noised and topped up with uniform
+ * clutter.
+ */
+class Radar
+{
+public:
+
+	explicit Radar(const RadarConfig& setConfig = RadarConfig(), unsigned int seed = 0)
+		: config(setConfig), generator(seed)
+	{}
+
+	void scan(const KinematicsWorld& world, const RadarPose& pose, long long timestamp, RadarReturns& returns)
+	{
+		const int n = (int)world.size();
+		rho.resize(n);
+		phi.resize(n);
+		rhoDot.resize(n);
+		measureKernel(n, world.x.data(), world.y.data(), world.velocity.data(), world.cosAngle.data(), world.sinAngle.data(),
+			pose, rho.data(), phi.data(), rhoDot.data());
+
+		returns.timestamp = timestamp;
+		returns.pose = pose;
+		returns.clear();
+		std::normal_distribution<float> unit(0, 1);
+		std::uniform_real_distribution<float> uniform(0, 1);
+		for(int i = 0; i < n; i++)
+		{
+			if(rho[i] < config.minRange || rho[i] > config.maxRange || std::fabs(phi[i]) > config.fov)
+				continue;
+			if(config.detectionProbability < 1 && uniform(generator) >= config.detectionProbability)
+				continue;
+			returns.push(rho[i] + config.stdRho*unit(generator), phi[i] + config.stdPhi*unit(generator), rhoDot[i] + config.stdRhoDot*unit(generator), i);
+		}
+
+		if(config.clutterDensity > 0)
+		{
+			double area = (config.maxRange - config.minRange) * 2 * config.fov;
+			int falseAlarms = std::poisson_distribution<int>(config.clutterDensity * area)(generator);
+			for(int k = 0; k < falseAlarms; k++)
+			{
+				float r = config.minRange + (config.maxRange - config.minRange)*uniform(generator);
+				float angle = config.fov*(2*uniform(generator) - 1);
+				returns.push(r, angle, config.clutterMaxSpeed*(2*uniform(generator) - 1), -1);
+			}
+		}
+	}
+
+	RadarConfig config;
+
+	/**
+	 * atan2 to within 1e-6 radians. Comparisons are replaced by arithmetic
+	 * and copysign, as the compiler will not turn floating point branches
+	 * into selects without -fno-trapping-math.
+	 */
+	static float fastAtan2(float y, float x)
+	{
+		const float quarterPi = (float)M_PI_4;
+		float ax = std::fabs(x), ay = std::fabs(y);
+		float spread = std::fabs(ax - ay);
+		float big = 0.5f*(ax + ay + spread);
+		float small = 0.5f*(ax + ay - spread);
+		// the tiny offset only matters at the origin, where small is 0 as well
+		float a = small / (big + 1e-30f);
+		float s = a*a;
+		float r = ((((-0.0040540580f*s + 0.0218612288f)*s - 0.0559098861f)*s + 0.0964200441f)*s - 0.1390853351f)*s;
+		r = ((r + 0.1994653599f)*s - 0.3332985605f)*s*a + a;
+		// pi/2 - r above the diagonal, then pi - r in the left half plane
+		r = quarterPi + std::copysign(1.0f, ay - ax)*(quarterPi - r);
+		r = 2*quarterPi + std::copysign(1.0f, x)*(r - 2*quarterPi);
+		return std::copysign(r, y);
+	}
+
+	/**
+	 * Noise free range, bearing relative to the boresight and range rate of
+	 * every car. Branch free over plain arrays, with a polynomial atan2, so
+	 * the compiler vectorizes it (given -fno-math-errno for the sqrt).
+	 */
+	static void measureKernel(int n, const double* __restrict x, const double* __restrict y, const float* __restrict velocity,
+		const float* __restrict cosAngle, const float* __restrict sinAngle, const RadarPose& pose,
+		float* __restrict rho, float* __restrict phi, float* __restrict rhoDot)
+	{
+		const double egoX = pose.x, egoY = pose.y;
+		const float cosYaw = std::cos(pose.yaw), sinYaw = std::sin(pose.yaw);
+		const float egoVx = pose.vx, egoVy = pose.vy;
+		for(int i = 0; i < n; i++)
+		{
+			// offsets in double, float only keeps cm far from the world origin
+			float dx = (float)(x[i] - egoX);
+			float dy = (float)(y[i] - egoY);
+			float r = std::sqrt(dx*dx + dy*dy);
+			float vx = velocity[i]*cosAngle[i] - egoVx;
+			float vy = velocity[i]*sinAngle[i] - egoVy;
+			rho[i] = r;
+			// a car at the radar has a zero numerator, the offset keeps that from being 0/0
+			rhoDot[i] = (dx*vx + dy*vy)/(r + 1e-30f);
+			// bearing in the radar's frame
+			phi[i] = fastAtan2(dy*cosYaw - dx*sinYaw, dx*cosYaw + dy*sinYaw);
+		}
+	}
+
+private:
+
+	std::mt19937 generator;
+	// noise free measurements of every car, scratch for scan
+	std::vector<float> rho, phi, rhoDot;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef RANGE_IMAGE_H
+#define RANGE_IMAGE_H
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// beam angles of a spinning lidar, one entry per layer and per column
+struct LidarBeams
+{
+	std::vector<float> elevationSin, elevationCos;
+	std::vector<float> azimuthSin, azimuthCos;
+	// azimuth between neighboring columns of a spinning() table
+	double azimuthIncrement;
+
+	LidarBeams()
+		: azimuthIncrement(0)
+	{}
+
+	int layers() const { return (int)elevationSin.size(); }
+	int columns() const { return (int)azimuthSin.size(); }
+
+	void addLayer(double elevation)
+	{
+		elevationSin.push_back(sin(elevation));
+		elevationCos.push_back(cos(elevation));
+	}
+
+	void addColumn(double azimuth)
+	{
+		azimuthSin.push_back(sin(azimuth));
+		azimuthCos.push_back(cos(azimuth));
+	}
+
+	/**
+	 * Evenly spaced beams, every angle computed from its index so that no
+	 * error accumulates across the sweep
+	 * @param lowestElevation elevation of layer 0, layers step upwards by elevationRange/numLayers
+	 * @param numColumns columns evenly covering a full turn, starting at azimuth 0
+	 */
+	static std::shared_ptr<const LidarBeams> spinning(int numLayers, double lowestElevation, double elevationRange, int numColumns, double fullTurn)
+	{
+		std::shared_ptr<LidarBeams> beams(new LidarBeams());
+		beams->elevationSin.reserve(numLayers);
+		beams->elevationCos.reserve(numLayers);
+		for(int layer = 0; layer < numLayers; layer++)
+			beams->addLayer(lowestElevation + layer * elevationRange / numLayers);
+		beams->azimuthSin.reserve(numColumns);
+		beams->azimuthCos.reserve(numColumns);
+		for(int column = 0; column < numColumns; column++)
+			beams->addColumn(column * fullTurn / numColumns);
+		beams->azimuthIncrement = fullTurn / numColumns;
+		return beams;
+	}
+};
+
+// one return, 4 bytes instead of the 16 of a pcl::PointXYZ
+struct RangeCell
+{
+	// in units of kRangeUnit, 0 for no return
+	uint16_t range;
+	uint16_t intensity;
+};
+
+// meters per range unit, 16 bits then cover 131 m
+const float kRangeUnit = 0.002f;
+
+/**
+ * Organized lidar output: a layers x columns grid of packed returns that
+ * keeps the beam structure of the scan. Points are only converted to XYZ
+ * when asked for, and the neighbors of a cell are the adjacent cells,
+ * with columns wrapping around the sweep.
+ */
+class RangeImage
+{
+public:
+	std::shared_ptr<const LidarBeams> beams;
+	// sensor position the ranges are measured from
+	float originX, originY, originZ;
+	std::vector<RangeCell> cells;
+
+	RangeImage()
+		: originX(0), originY(0), originZ(0)
+	{}
+
+	// size for the given beams and clear all returns
+	void reset(const std::shared_ptr<const LidarBeams>& setBeams, float x, float y, float z)
+	{
+		beams = setBeams;
+		originX = x;
+		originY = y;
+		originZ = z;
+		cells.assign((size_t)beams->layers() * beams->columns(), RangeCell{0, 0});
+	}
+
+	int layers() const { return beams ? beams->layers() : 0; }
+	int columns() const { return beams ? beams->columns() : 0; }
+
+	int index(int layer, int column) const { return layer * columns() + column; }
+	RangeCell& at(int layer, int column) { return cells[index(layer, column)]; }
+	const RangeCell& at(int layer, int column) const { return cells[index(layer, column)]; }
+
+	bool valid(int layer, int column) const { return at(layer, column).range != 0; }
+	float range(int layer, int column) const { return at(layer, column).range * kRangeUnit; }
+
+	void set(int layer, int column, double range, uint16_t intensity)
+	{
+		double units = range / kRangeUnit + 0.5;
+		RangeCell& cell = at(layer, column);
+		cell.range = units < 1 ? 1 : units > 65535 ? 65535 : (uint16_t)units;
+		cell.intensity = intensity;
+	}
+
+	// XYZ of a cell, NaN for cells without a return
+	pcl::PointXYZ point(int layer, int column) const
+	{
+		if(!valid(layer, column))
+		{
+			float nan = std::numeric_limits<float>::quiet_NaN();
+			return pcl::PointXYZ(nan, nan, nan);
+		}
+		float r = range(layer, column);
+		float horizontal = r * beams->elevationCos[layer];
+		return pcl::PointXYZ(originX + horizontal * beams->azimuthCos[column],
+			originY + horizontal * beams->azimuthSin[column],
+			originZ + r * beams->elevationSin[layer]);
+	}
+
+	/**
+	 * Cell offset by (dLayer, dColumn), columns wrap around the sweep
+	 * @return false if the layer falls outside the image
+	 */
+	bool neighbor(int layer, int column, int dLayer, int dColumn, int& outLayer, int& outColumn) const
+	{
+		outLayer = layer + dLayer;
+		if(outLayer < 0 || outLayer >= layers())
+			return false;
+		int n = columns();
+		outColumn = ((column + dColumn) % n + n) % n;
+		return true;
+	}
+
+	// organized cloud in PCL's convention, NaN points where there is no return
+	pcl::PointCloud<pcl::PointXYZ>::Ptr toCloud() const
+	{
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>());
+		cloud->points.reserve(cells.size());
+		for(int layer = 0; layer < layers(); layer++)
+			for(int column = 0; column < columns(); column++)
+				cloud->points.push_back(point(layer, column));
+		cloud->width = columns();
+		cloud->height = layers();
+		cloud->is_dense = false;
+		return cloud;
+	}
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <vector>
 #include "Eigen/Dense"
 #include "render/render.h"
+#include "frames.h"
 #include <pcl/io/pcd_io.h>
 
 using Eigen::MatrixXd;
@@ -42,10 +43,13 @@ class Tools {
 	// Members
 	std::vector<VectorXd> estimations;
 	std::vector<VectorXd> ground_truth;
+	// when set, measurements are brought into the world frame of this sensor before the update
+	const FrameSet* worldFrames = nullptr;
+	int worldSensor = 0;
 	
 	double noise(double stddev, long long seedNum);
 	lmarker lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
-	rmarker radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
+	rmarker radarSense(Car& car, const Car& ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
 	void ukfResults(Car car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps);
 	/**
 	* A helper method to calculate RMSE.
@@ -0,0 +1,97 @@
+#include "trace.h"
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> traceEnabled(false);
+
+namespace {
+
+// events kept per thread, older ones are overwritten
+const size_t kTraceCapacity = 1 << 16;
+
+struct TraceBuffer
+{
+	int tid;
+	std::atomic<size_t> count;
+	std::vector<TraceEvent> events;
+
+	explicit TraceBuffer(int setTid)
+		: tid(setTid), count(0), events(kTraceCapacity)
+	{}
+};
+
+std::mutex registryLock;
+// buffers are never freed so events of finished threads stay exportable
+std::vector<TraceBuffer*> registry;
+
+TraceBuffer* threadBuffer()
+{
+	thread_local TraceBuffer* buffer = nullptr;
+	if(!buffer)
+	{
+		std::lock_guard<std::mutex> guard(registryLock);
+		buffer = new TraceBuffer((int)registry.size());
+		registry.push_back(buffer);
+	}
+	return buffer;
+}
+
+}
+
+void traceEnable(bool enable)
+{
+	traceEnabled.store(enable, std::memory_order_relaxed);
+}
+
+long long traceNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void traceRecord(const char* name, long long start_ns, long long end_ns)
+{
+	TraceBuffer* buffer = threadBuffer();
+	size_t n = buffer->count.load(std::memory_order_relaxed);
+	TraceEvent& event = buffer->events[n % kTraceCapacity];
+	event.name = name;
+	event.start_ns = start_ns;
+	event.duration_ns = end_ns - start_ns;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+void traceClear()
+{
+	std::lock_guard<std::mutex> guard(registryLock);
+	for(TraceBuffer* buffer : registry)
+		buffer->count.store(0, std::memory_order_relaxed);
+}
+
+bool traceWriteChrome(const std::string& file)
+{
+	std::ofstream out(file.c_str());
+	if(!out)
+		return false;
+
+	std::lock_guard<std::mutex> guard(registryLock);
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for(TraceBuffer* buffer : registry)
+	{
+		size_t n = buffer->count.load(std::memory_order_acquire);
+		size_t begin = n > kTraceCapacity ? n - kTraceCapacity : 0;
+		for(size_t i = begin; i < n; i++)
+		{
+			const TraceEvent& event = buffer->events[i % kTraceCapacity];
+			out << (first ? "\n" : ",\n");
+			// trace event timestamps and durations are in microseconds
+			out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"ts\":" << event.start_ns/1000.0 << ",\"dur\":" << event.duration_ns/1000.0 << "}";
+			first = false;
+		}
+	}
+	out << "\n]}\n";
+	return (bool)out;
+}
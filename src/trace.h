@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/**
+ * Lightweight scoped timers for the hot path.
+ *
+ * TRACE_SCOPE("name") records the duration of the enclosing scope into a
+ * ring buffer owned by the calling thread, so recording never takes a
+ * lock. While tracing is disabled a scope costs one relaxed atomic load;
+ * building with UKF_NO_TRACE removes the scopes altogether. The collected
+ * events can be written in Chrome trace event format and opened in
+ * chrome://tracing or the Perfetto UI.
+ *
+ * Names must be string literals or otherwise outlive the trace.
+ */
+
+struct TraceEvent
+{
+	const char* name;
+	long long start_ns;
+	long long duration_ns;
+};
+
+// enable or disable recording for all threads
+void traceEnable(bool enable);
+
+// write every recorded event as Chrome trace JSON, call while traced threads are idle
+bool traceWriteChrome(const std::string& file);
+
+// drop all recorded events
+void traceClear();
+
+extern std::atomic<bool> traceEnabled;
+
+long long traceNow();
+
+void traceRecord(const char* name, long long start_ns, long long end_ns);
+
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* setName)
+		: name(setName), start(traceEnabled.load(std::memory_order_relaxed) ? traceNow() : -1)
+	{}
+
+	~TraceScope()
+	{
+		if(start >= 0)
+			traceRecord(name, start, traceNow());
+	}
+
+private:
+	const char* name;
+	long long start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef UKF_NO_TRACE
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#endif
+
+#endif /* TRACE_H */
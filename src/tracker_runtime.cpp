@@ -0,0 +1,187 @@
+#include "tracker_runtime.h"
+#include <algorithm>
+#include <cmath>
+#include "trace.h"
+
+namespace {
+
+// position along the road a measurement was taken at
+double positionOf(const Measurement& measurement)
+{
+	if(measurement.sensor == MeasurementPackage::LASER)
+		return measurement.values[0];
+	return measurement.sensorX + measurement.values[0]*std::cos(measurement.values[1]);
+}
+
+}
+
+TrackerRuntime::TrackerRuntime(int numWorkers, Partition setPartition, double setRegionLength)
+	: migrations(0), partition(setPartition), regionLength(setRegionLength), generation(0), pending(0), stopping(false)
+{
+	numWorkers = std::max(1, numWorkers);
+	for(int w = 0; w < numWorkers; w++)
+	{
+		shards.push_back(std::unique_ptr<Shard>(new Shard()));
+		shards.back()->processed = 0;
+	}
+	for(int w = 0; w < numWorkers; w++)
+		threads.push_back(std::thread(&TrackerRuntime::run, this, w));
+}
+
+TrackerRuntime::~TrackerRuntime()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	start.notify_all();
+	for(std::thread& thread : threads)
+		thread.join();
+}
+
+int TrackerRuntime::ownerOf(int id, double x) const
+{
+	int n = (int)shards.size();
+	if(partition == BY_TRACK_ID)
+		return (id % n + n) % n;
+	long long stripe = (long long)std::floor(x / regionLength);
+	return (int)((stripe % n + n) % n);
+}
+
+void TrackerRuntime::process(const std::vector<Measurement>& measurements)
+{
+	TRACE_SCOPE("TrackerRuntime::process");
+	for(const Measurement& measurement : measurements)
+	{
+		std::unordered_map<int, int>::iterator it = owner.find(measurement.track);
+		if(it == owner.end())
+			it = owner.insert(std::make_pair(measurement.track, ownerOf(measurement.track, positionOf(measurement)))).first;
+		shards[it->second]->inbox.push_back(measurement);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		generation++;
+		pending = (int)shards.size();
+		start.notify_all();
+		finished.wait(lock, [this]() { return pending == 0; });
+	}
+
+	if(partition == BY_REGION)
+		migrate();
+}
+
+void TrackerRuntime::run(int worker)
+{
+	long long seen = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start.wait(lock, [&]() { return stopping || generation > seen; });
+			if(stopping)
+				return;
+			seen = generation;
+		}
+		work(*shards[worker], worker);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--pending == 0)
+				finished.notify_one();
+		}
+	}
+}
+
+void TrackerRuntime::work(Shard& shard, int worker)
+{
+	TRACE_SCOPE("TrackerRuntime::work");
+	for(const Measurement& measurement : shard.inbox)
+	{
+		std::unordered_map<int, size_t>::iterator it = shard.index.find(measurement.track);
+		if(it == shard.index.end())
+		{
+			shard.tracks.push_back(TrackState());
+			shard.tracks.back().id = measurement.track;
+			// the filter's clock starts at the track's first measurement, not at 0
+			shard.tracks.back().ukf.time_us_ = measurement.timestamp;
+			it = shard.index.insert(std::make_pair(measurement.track, shard.tracks.size() - 1)).first;
+		}
+		shard.tracks[it->second].ukf.ProcessMeasurement(measurement.toPackage());
+		shard.processed++;
+	}
+	shard.inbox.clear();
+
+	// tracks that drove into another worker's region
+	shard.leaving.clear();
+	if(partition == BY_REGION)
+	{
+		for(size_t i = 0; i < shard.tracks.size(); i++)
+			if(ownerOf(shard.tracks[i].id, shard.tracks[i].ukf.x_(0)) != worker)
+				shard.leaving.push_back(i);
+	}
+}
+
+// take track i out of the shard by swapping the last track into its place
+void TrackerRuntime::detach(Shard& shard, size_t i)
+{
+	shard.index.erase(shard.tracks[i].id);
+	if(i != shard.tracks.size() - 1)
+	{
+		shard.tracks[i] = shard.tracks.back();
+		shard.index[shard.tracks[i].id] = i;
+	}
+	shard.tracks.pop_back();
+}
+
+void TrackerRuntime::migrate()
+{
+	for(size_t from = 0; from < shards.size(); from++)
+	{
+		Shard& shard = *shards[from];
+		// from the back, so swapping with the last track keeps pending indices valid
+		for(std::vector<size_t>::reverse_iterator it = shard.leaving.rbegin(); it != shard.leaving.rend(); ++it)
+		{
+			size_t i = *it;
+			TrackState& track = shard.tracks[i];
+			int to = ownerOf(track.id, track.ukf.x_(0));
+			Shard& destination = *shards[to];
+			destination.tracks.push_back(track);
+			destination.index[track.id] = destination.tracks.size() - 1;
+			owner[track.id] = to;
+			detach(shard, i);
+			migrations++;
+		}
+		shard.leaving.clear();
+	}
+}
+
+const UKF* TrackerRuntime::find(int id) const
+{
+	std::unordered_map<int, int>::const_iterator it = owner.find(id);
+	if(it == owner.end())
+		return nullptr;
+	const Shard& shard = *shards[it->second];
+	std::unordered_map<int, size_t>::const_iterator track = shard.index.find(id);
+	return track == shard.index.end() ? nullptr : &shard.tracks[track->second].ukf;
+}
+
+bool TrackerRuntime::remove(int id)
+{
+	std::unordered_map<int, int>::iterator it = owner.find(id);
+	if(it == owner.end())
+		return false;
+	Shard& shard = *shards[it->second];
+	std::unordered_map<int, size_t>::iterator track = shard.index.find(id);
+	if(track != shard.index.end())
+		detach(shard, track->second);
+	owner.erase(it);
+	return true;
+}
+
+std::vector<long long> TrackerRuntime::load() const
+{
+	std::vector<long long> processed;
+	for(const std::unique_ptr<Shard>& shard : shards)
+		processed.push_back(shard->processed);
+	return processed;
+}
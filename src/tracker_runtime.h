@@ -0,0 +1,100 @@
+#ifndef TRACKER_RUNTIME_H_
+#define TRACKER_RUNTIME_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "measurement_queue.h"
+#include "ukf.h"
+
+// a track and the filter that follows it
+struct TrackState
+{
+	int id;
+	UKF ukf;
+};
+
+/**
+ * Tracks spread over worker threads that each own their tracks outright:
+ * a track's filter is only ever touched by its worker, so x_ and P_ need no
+ * locks. Frames run bulk synchronously. process() hands every worker the
+ * measurements of its tracks, the workers update in parallel, and between
+ * frames the calling thread moves tracks whose owner changed, which is
+ * the only time a filter changes hands.
+ */
+class TrackerRuntime
+{
+public:
+
+	enum Partition
+	{
+		// track id modulo workers, tracks never move
+		BY_TRACK_ID,
+		// stripes of regionLength meters along the road, assigned round robin
+		BY_REGION
+	};
+
+	TrackerRuntime(int numWorkers, Partition setPartition, double setRegionLength = 50);
+	~TrackerRuntime();
+
+	/**
+	 * Update the tracks with one frame of measurements, sorted by time.
+	 * Measurements of unknown track ids start new tracks.
+	 */
+	void process(const std::vector<Measurement>& measurements);
+
+	// between frames only, nullptr for unknown ids
+	const UKF* find(int id) const;
+
+	/**
+	 * Drop a track and its filter, between frames only. A later
+	 * measurement of the id starts a new track.
+	 * @return false for unknown ids
+	 */
+	bool remove(int id);
+
+	int workers() const { return (int)shards.size(); }
+	size_t tracks() const { return owner.size(); }
+	// tracks moved between workers so far
+	long long migrations;
+
+	// measurements each worker has processed
+	std::vector<long long> load() const;
+
+private:
+
+	struct Shard
+	{
+		std::vector<TrackState> tracks;
+		std::unordered_map<int, size_t> index;
+		std::vector<Measurement> inbox;
+		// indices of tracks that belong to another worker after this frame
+		std::vector<size_t> leaving;
+		long long processed;
+	};
+
+	int ownerOf(int id, double x) const;
+	static void detach(Shard& shard, size_t i);
+	void run(int worker);
+	void work(Shard& shard, int worker);
+	void migrate();
+
+	const Partition partition;
+	const double regionLength;
+	std::vector<std::unique_ptr<Shard> > shards;
+	std::unordered_map<int, int> owner;
+
+	// frame barrier, generation counts started frames
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable finished;
+	long long generation;
+	int pending;
+	bool stopping;
+	std::vector<std::thread> threads;
+};
+
+#endif /* TRACKER_RUNTIME_H_ */
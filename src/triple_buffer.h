@@ -0,0 +1,57 @@
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include <atomic>
+
+/**
+ * Lock-free single producer single consumer handoff of the latest value.
+ * The writer fills back() and publishes it by swapping it with the middle
+ * slot; the reader swaps the middle slot into front() when it holds a
+ * newer value. Neither side ever waits, values the reader is too slow for
+ * are simply overwritten.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: middle(1), backIndex(0), frontIndex(2)
+	{}
+
+	// writer side, the slot to fill next
+	T& back() { return slots[backIndex]; }
+
+	void publish()
+	{
+		int previous = middle.exchange(backIndex | kFresh, std::memory_order_acq_rel);
+		backIndex = previous & kIndexMask;
+	}
+
+	/**
+	 * Reader side, take the newest published value if there is one
+	 * @return true if front() changed
+	 */
+	bool consume()
+	{
+		if(!(middle.load(std::memory_order_relaxed) & kFresh))
+			return false;
+		int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+		frontIndex = previous & kIndexMask;
+		return true;
+	}
+
+	const T& front() const { return slots[frontIndex]; }
+
+private:
+	static const int kIndexMask = 3;
+	static const int kFresh = 4;
+
+	T slots[3];
+	// index of the middle slot, with kFresh set while it holds an unread value
+	alignas(64) std::atomic<int> middle;
+	// owned by the writer and the reader respectively
+	alignas(64) int backIndex;
+	alignas(64) int frontIndex;
+};
+
+#endif /* TRIPLE_BUFFER_H_ */
@@ -1,14 +1,14 @@
 #include "ukf.h"
 #include "Eigen/Dense"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
-using Eigen::MatrixXd;
-using Eigen::VectorXd;
-
 /**
  * Initializes Unscented Kalman filter
  */
-UKF::UKF() {
+template <typename Scalar>
+UKFT<Scalar>::UKFT() {
   // if this is false, laser measurements will be ignored (except during init)
   use_laser_ = true;
 
@@ -16,10 +16,10 @@ UKF::UKF() {
   use_radar_ = true;
 
   // initial state vector
-  x_ = VectorXd(5);
+  x_ = VectorX(5);
 
   // initial covariance matrix
-  P_ = MatrixXd(5, 5);
+  P_ = MatrixX(5, 5);
 
   // Process noise standard deviation longitudinal acceleration in m/s^2
   std_a_ = 1.0;
@@ -63,220 +63,136 @@ UKF::UKF() {
 
   n_aug_ =  7;
 
-  lambda_ = 3 - n_aug_;  
-
-  x_ = Eigen::VectorXd::Zero(n_x_);
+  x_ = VectorX::Zero(n_x_);
 
-  P_ = Eigen::MatrixXd::Identity(n_x_, n_x_);
+  P_ = MatrixX::Identity(n_x_, n_x_);
   P_(3,3) = 0.3*0.3; 
   P_(4,4) = 0.3*0.3;
 
-  Xsig_pred_ = Eigen::MatrixXd::Zero(n_x_, 2 * n_aug_ + 1);
-  
   NIS_lidar = 0;
 
   NIS_radar = 0;
 
-  setWeight();
+  cov_update_ = sizeof(Scalar) < sizeof(double) ? JOSEPH : STANDARD;
+
+  min_eigenvalue_ = 1e-6;
+
+  SetUnscentedTransform(UnscentedTransform::Default(n_aug_));
 }
 
-UKF::~UKF() {}
+template <typename Scalar>
+UKFT<Scalar>::~UKFT() {}
 
-void UKF::setWeight(){
-  weights_ = VectorXd(2*n_aug_+1);
-  double weight_0 = lambda_/(lambda_+n_aug_);
-  double weight = 0.5/(lambda_+n_aug_);
-  weights_(0) = weight_0;
-  for (int i=1; i<2*n_aug_+1; ++i) {  
-    weights_(i) = weight;
-  }
+template <typename Scalar>
+void UKFT<Scalar>::SetUnscentedTransform(const typename UnscentedTransform::Ptr& ut){
+  ut_ = ut;
+  lambda_ = ut_->lambda_;
+  Xsig_pred_ = MatrixX::Zero(n_x_, ut_->n_sig_);
 }
 
-void UKF::GenerateSigmaPoints(Eigen::MatrixXd* Xsig_out) {
-  Eigen::MatrixXd Xsig = Eigen::MatrixXd(n_x_, 2 * n_x_ + 1);
-  Eigen::MatrixXd A = P_.llt().matrixL();
+template <typename Scalar>
+void UKFT<Scalar>::GenerateSigmaPoints(MatrixX* Xsig_out) {
+  MatrixX Xsig = MatrixX(n_x_, 2 * n_x_ + 1);
+  MatrixX A = P_.llt().matrixL();
   Xsig.col(0) = x_;
   for (int i = 0; i < n_x_; ++i) {
-    Xsig.col(i+1)     = x_ + sqrt(lambda_+n_x_) * A.col(i);
-    Xsig.col(i+1+n_x_) = x_ - sqrt(lambda_+n_x_) * A.col(i);
+    Xsig.col(i+1)     = x_ + std::sqrt(lambda_+n_x_) * A.col(i);
+    Xsig.col(i+1+n_x_) = x_ - std::sqrt(lambda_+n_x_) * A.col(i);
   }
   *Xsig_out = Xsig;
 }
 
-void UKF::norm(double& val){
-  while (val> M_PI) {
-    val-=2.*M_PI;
-  }
-  while (val<-M_PI) {
-    val+=2.*M_PI;
-  }
+template <typename Scalar>
+void UKFT<Scalar>::norm(Scalar& val){
+  NormalizeAngle(val);
 }
 
-void UKF::AugmentSigmaPoints(Eigen::MatrixXd& Xsig_aug) {
-  Eigen::VectorXd x_aug = Eigen::VectorXd::Zero(n_aug_);
-  x_aug.head(5) = x_;
-  // x_aug(5) = 0;
-  // x_aug(6) = 0;
-  Eigen::MatrixXd P_aug = Eigen::MatrixXd::Zero(n_aug_, n_aug_);
-  P_aug.topLeftCorner(5,5) = P_;
-  P_aug(5,5) = std_a_*std_a_;
-  P_aug(6,6) = std_yawdd_*std_yawdd_;
-  Eigen::MatrixXd A = P_aug.llt().matrixL();
-  Xsig_aug = MatrixXd(n_aug_, 2 * n_aug_ + 1);
-  Xsig_aug.col(0) = x_aug;
-  for (int i = 0; i < n_aug_; ++i) {
-    Xsig_aug.col(i+1)     = x_aug + sqrt(lambda_+n_aug_) * A.col(i);
-    Xsig_aug.col(i+1+n_aug_) = x_aug - sqrt(lambda_+n_aug_) * A.col(i);
+/**
+ * The augmented covariance is blockdiag(P_, diag(std_a_^2, std_yawdd_^2)),
+ * so its Cholesky factor is blockdiag(L, diag(std_a_, std_yawdd_)). Only
+ * the 5x5 P_ is factored; the noise rows of the sigma points are the unit
+ * offsets scaled by the noise standard deviations, around a zero mean.
+ */
+template <typename Scalar>
+void UKFT<Scalar>::AugmentSigmaPoints(MatrixX& Xsig_aug) {
+  TRACE_SCOPE("UKF::AugmentSigmaPoints");
+  Eigen::LLT<MatrixX> llt(P_);
+  if (llt.info() != Eigen::Success) {
+    // P_ lost positive definiteness, repair it instead of spreading NaNs
+    health_.llt_failures++;
+    health_.repairs++;
+    RepairCovariance(P_);
+    llt.compute(P_);
   }
+  MatrixX L = llt.matrixL();
+  Scalar l_min = std::min(L.diagonal().minCoeff(), std::min(std_a_, std_yawdd_));
+  Scalar l_max = std::max(L.diagonal().maxCoeff(), std::max(std_a_, std_yawdd_));
+  health_.condition_estimate = l_min > 0 ? (l_max/l_min)*(l_max/l_min) : HUGE_VAL;
+  const MatrixX& unit = ut_->unit_sigma_;
+  Xsig_aug = MatrixX(n_aug_, ut_->n_sig_);
+  Xsig_aug.topRows(n_x_) = L * unit.topRows(n_x_);
+  Xsig_aug.topRows(n_x_).colwise() += x_;
+  Xsig_aug.row(5) = std_a_ * unit.row(5);
+  Xsig_aug.row(6) = std_yawdd_ * unit.row(6);
 }
 
-void UKF::PredictSigmaPoint(const Eigen::MatrixXd& Xsig_aug, const double delta_t) {
-  for (int i = 0; i< 2*n_aug_+1; ++i) {
-    double p_x      = Xsig_aug(0,i);
-    double p_y      = Xsig_aug(1,i);
-    double v        = Xsig_aug(2,i);
-    double yaw      = Xsig_aug(3,i);
-    double yawd     = Xsig_aug(4,i);
-    double nu_a     = Xsig_aug(5,i);
-    double nu_yawdd = Xsig_aug(6,i);
-    double px_p, py_p;
-    if (fabs(yawd) > 0.001) {
-        px_p = p_x + v/yawd * ( sin (yaw + yawd*delta_t) - sin(yaw));
-        py_p = p_y + v/yawd * ( cos(yaw) - cos(yaw + yawd*delta_t) );
-    } else {
-        px_p = p_x + v*delta_t*cos(yaw);
-        py_p = p_y + v*delta_t*sin(yaw);
-    }
-    double v_p = v;
-    double yaw_p = yaw + yawd*delta_t;
-    double yawd_p = yawd;
-    px_p = px_p + 0.5*nu_a*delta_t*delta_t * cos(yaw);
-    py_p = py_p + 0.5*nu_a*delta_t*delta_t * sin(yaw);
-    v_p = v_p + nu_a*delta_t;
-    yaw_p = yaw_p + 0.5*nu_yawdd*delta_t*delta_t;
-    yawd_p = yawd_p + nu_yawdd*delta_t;
-    Xsig_pred_(0,i) = px_p;
-    Xsig_pred_(1,i) = py_p;
-    Xsig_pred_(2,i) = v_p;
-    Xsig_pred_(3,i) = yaw_p;
-    Xsig_pred_(4,i) = yawd_p;
-  }
+template <typename Scalar>
+void UKFT<Scalar>::PredictSigmaPoint(const MatrixX& Xsig_aug, const double delta_t) {
+  PredictSigmaPoints(CtrvModel(), Xsig_aug, delta_t);
 }
 
-void UKF::PredictMeanAndCovariance() {
-  x_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    x_ = x_ + weights_(i) * Xsig_pred_.col(i);
-  }
-  P_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    norm(x_diff(3));
-    P_ = P_ + weights_(i) * x_diff * x_diff.transpose() ;
-  }
+template <typename Scalar>
+void UKFT<Scalar>::PredictMeanAndCovariance() {
+  TRACE_SCOPE("UKF::PredictMeanAndCovariance");
+  x_ = Xsig_pred_ * ut_->weights_m_;
+  MatrixX Xdiff = Xsig_pred_.colwise() - x_;
+  NormalizeAngles(Xdiff.row(3));
+  P_ = Xdiff * ut_->weights_c_.asDiagonal() * Xdiff.transpose();
 }
 
-void UKF::PredictMeasurementLidar(Eigen::VectorXd& z_out, Eigen::MatrixXd& S_out, Eigen::MatrixXd& Zsig) {
-  int n_z = 2;
-  Zsig = Eigen::MatrixXd(n_z, 2 * n_aug_ + 1);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    Zsig(0,i) = Xsig_pred_(0,i);
-    Zsig(1,i) = Xsig_pred_(1,i);
-  }
-  Eigen::VectorXd z_pred = Eigen::VectorXd::Zero(n_z);
-  for (int i=0; i < 2*n_aug_+1; ++i) {
-    z_pred = z_pred + weights_(i) * Zsig.col(i);
-  }
-  Eigen::MatrixXd S = Eigen::MatrixXd::Zero(n_z,n_z);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i){
-    Eigen::VectorXd z_diff = Zsig.col(i) - z_pred;
-    S = S + weights_(i) * z_diff * z_diff.transpose();
-  }
-  Eigen::MatrixXd R = Eigen::MatrixXd(n_z,n_z);
-  R <<  std_laspx_*std_laspx_, 0,
-        0, std_laspy_*std_laspy_;
-  S = S + R;
-  z_out = z_pred;
-  S_out = S;
+template <typename Scalar>
+void UKFT<Scalar>::PredictMeasurementLidar(VectorX& z_out, MatrixX& S_out, MatrixX& Zsig) {
+  PredictMeasurement(LidarModel(std_laspx_, std_laspy_), z_out, S_out, Zsig);
 }
 
-void UKF::UpdateStateLidar(const Eigen::MatrixXd& Zsig,      //sigma points in measurement space
-                          const Eigen::VectorXd& z_pred,    //predicted measurement mean
-                          const Eigen::MatrixXd& S,         //predicted measurement covariance
-                          const Eigen::VectorXd& z         //incoming measurement
+template <typename Scalar>
+void UKFT<Scalar>::UpdateStateLidar(const MatrixX& Zsig,      //sigma points in measurement space
+                          const VectorX& z_pred,    //predicted measurement mean
+                          const MatrixX& S,         //predicted measurement covariance
+                          const VectorX& z         //incoming measurement
                           ) {
-  Eigen::MatrixXd Tc = Eigen::MatrixXd::Zero(n_x_, Zsig.rows());
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {  // 2n+1 simga points
-    // residual
-    Eigen::VectorXd z_diff = Zsig.col(i) - z_pred;
-    Eigen::VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    norm(x_diff(3));
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
-  }
-  Eigen::MatrixXd S_Inverse = S.inverse();
-  Eigen::MatrixXd K = Tc * S_Inverse;
-  Eigen::VectorXd z_diff = z - z_pred;
-  x_ = x_ + K * z_diff;
-  P_ = P_ - K*S*K.transpose();
-  NIS_lidar = z_diff.transpose() * S_Inverse * z_diff;
+  NIS_lidar = UpdateState(LidarModel(std_laspx_, std_laspy_), Zsig, z_pred, S, z);
 }
 
-void UKF::PredictMeasurementRadar(Eigen::VectorXd& z_out, Eigen::MatrixXd& S_out, Eigen::MatrixXd& Zsig) {
-  int n_z = 3;
-  Zsig = Eigen::MatrixXd(n_z, 2 * n_aug_ + 1);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    double p_x    = Xsig_pred_(0,i);
-    double p_y    = Xsig_pred_(1,i);
-    double v      = Xsig_pred_(2,i);
-    double yaw    = Xsig_pred_(3,i);
-    double v1     = cos(yaw)*v;
-    double v2     = sin(yaw)*v;
-    Zsig(0,i) = sqrt(p_x*p_x + p_y*p_y);                       
-    Zsig(1,i) = atan2(p_y,p_x);                                
-    Zsig(2,i) = (p_x*v1 + p_y*v2) / sqrt(p_x*p_x + p_y*p_y);
-  }
-  Eigen::VectorXd z_pred = Eigen::VectorXd::Zero(n_z);
-  for (int i=0; i < 2*n_aug_+1; ++i) {
-    z_pred = z_pred + weights_(i) * Zsig.col(i);
-  }
-  Eigen::MatrixXd S = Eigen::MatrixXd::Zero(n_z,n_z);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    Eigen::VectorXd z_diff = Zsig.col(i) - z_pred;
-    norm(z_diff(1));
-    S = S + weights_(i) * z_diff * z_diff.transpose();
-  }
-  Eigen::MatrixXd R = Eigen::MatrixXd(n_z,n_z);
-  R <<  std_radr_*std_radr_, 0, 0,
-        0, std_radphi_*std_radphi_, 0,
-        0, 0,std_radrd_*std_radrd_;
-  S = S + R;
-  z_out = z_pred;
-  S_out = S;
+template <typename Scalar>
+void UKFT<Scalar>::PredictMeasurementRadar(VectorX& z_out, MatrixX& S_out, MatrixX& Zsig) {
+  PredictMeasurement(RadarModel(std_radr_, std_radphi_, std_radrd_), z_out, S_out, Zsig);
 }
 
-void UKF::UpdateStateRadar(const Eigen::MatrixXd& Zsig,    //sigma points in measurement space
-                          const Eigen::VectorXd& z_pred,   //predicted measurement mean
-                          const Eigen::MatrixXd& S,        //predicted measurement covariance
-                          const Eigen::VectorXd& z         //incoming measurement
+template <typename Scalar>
+void UKFT<Scalar>::UpdateStateRadar(const MatrixX& Zsig,    //sigma points in measurement space
+                          const VectorX& z_pred,   //predicted measurement mean
+                          const MatrixX& S,        //predicted measurement covariance
+                          const VectorX& z         //incoming measurement
                           ) {
-  Eigen::MatrixXd Tc = Eigen::MatrixXd::Zero(n_x_, Zsig.rows());
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    Eigen::VectorXd z_diff = Zsig.col(i) - z_pred;
-    norm(z_diff(1));
-    Eigen::VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    norm(x_diff(3));
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
-  }
-  Eigen::MatrixXd S_Inverse = S.inverse();
-  Eigen::MatrixXd K = Tc * S_Inverse;
-  Eigen::VectorXd z_diff = z - z_pred;
-  norm(z_diff(1));
-  x_ = x_ + K * z_diff;
-  P_ = P_ - K*S*K.transpose();
-  NIS_radar = z_diff.transpose() * S_Inverse * z_diff;
+  NIS_radar = UpdateState(RadarModel(std_radr_, std_radphi_, std_radrd_), Zsig, z_pred, S, z);
 }
 
-void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
+/**
+ * Restore a symmetric positive definite covariance: symmetrize, then
+ * floor the eigenvalues at min_eigenvalue_.
+ */
+template <typename Scalar>
+void UKFT<Scalar>::RepairCovariance(MatrixX& P) {
+  P = 0.5 * (P + P.transpose());
+  Eigen::SelfAdjointEigenSolver<MatrixX> eig(P);
+  VectorX d = eig.eigenvalues().cwiseMax(min_eigenvalue_);
+  P = eig.eigenvectors() * d.asDiagonal() * eig.eigenvectors().transpose();
+}
+
+template <typename Scalar>
+void UKFT<Scalar>::ProcessMeasurement(MeasurementPackage meas_package) {
+  TRACE_SCOPE("UKF::ProcessMeasurement");
   /**
    * TODO: Complete this function! Make sure you switch between lidar and radar
    * measurements.
@@ -291,56 +207,50 @@ void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
   }
 }
 
-void UKF::Prediction(double delta_t) {
+template <typename Scalar>
+void UKFT<Scalar>::Prediction(double delta_t) {
   /**
    * TODO: Complete this function! Estimate the object's location. 
    * Modify the state vector, x_. Predict sigma points, the state, 
    * and the state covariance matrix.
    */
-  if(is_initialized_){
-    Eigen::MatrixXd Xsig_aug;
-    AugmentSigmaPoints(Xsig_aug);
-    PredictSigmaPoint(Xsig_aug, delta_t);
-    PredictMeanAndCovariance(); 
-  }
+  Prediction(CtrvModel(), delta_t);
 }
 
-void UKF::UpdateLidar(MeasurementPackage meas_package) {
+template <typename Scalar>
+void UKFT<Scalar>::UpdateLidar(MeasurementPackage meas_package) {
   /**
    * TODO: Complete this function! Use lidar data to update the belief 
    * about the object's position. Modify the state vector, x_, and 
    * covariance, P_.
    * You can also calculate the lidar NIS, if desired.
    */
+  LidarModel model(std_laspx_, std_laspy_, meas_package.sensor_vx_, meas_package.sensor_vy_);
   if(is_initialized_){
-    Eigen::VectorXd z_pred;
-    Eigen::MatrixXd S;
-    Eigen::MatrixXd ZSig;
-    PredictMeasurementLidar(z_pred, S, ZSig);
-    UpdateStateLidar(ZSig, z_pred, S, meas_package.raw_measurements_);
+    // the lidar model is linear, Update takes the closed form path
+    NIS_lidar = Update(model, meas_package.raw_measurements_.cast<Scalar>());
   }else{
-    x_(0) = meas_package.raw_measurements_(0);
-    x_(1) = meas_package.raw_measurements_(1);
-    is_initialized_ = true;
+    is_initialized_ = model.Initialize(meas_package.raw_measurements_, x_, P_);
   }
 }
 
-void UKF::UpdateRadar(MeasurementPackage meas_package) {
+template <typename Scalar>
+void UKFT<Scalar>::UpdateRadar(MeasurementPackage meas_package) {
   /**
    * TODO: Complete this function! Use radar data to update the belief 
    * about the object's position. Modify the state vector, x_, and 
    * covariance, P_.
    * You can also calculate the radar NIS, if desired.
    */
-  if(is_initialized_){;
-    Eigen::VectorXd z_pred;
-    Eigen::MatrixXd S;
-    Eigen::MatrixXd ZSig;
-    PredictMeasurementRadar(z_pred, S, ZSig);
-    UpdateStateRadar(ZSig, z_pred, S, meas_package.raw_measurements_);
+  // measured relative to the sensor, which is at the origin unless the package was moved into another frame
+  RadarModel model(std_radr_, std_radphi_, std_radrd_,
+                   meas_package.sensor_x_, meas_package.sensor_y_, meas_package.sensor_vx_, meas_package.sensor_vy_);
+  if(is_initialized_){
+    NIS_radar = Update(model, meas_package.raw_measurements_.cast<Scalar>());
   }else{
-    x_(0) = meas_package.raw_measurements_(0)*cos(meas_package.raw_measurements_(1));
-    x_(1) = meas_package.raw_measurements_(0)*sin(meas_package.raw_measurements_(1));
-    is_initialized_ = true; 
+    is_initialized_ = model.Initialize(meas_package.raw_measurements_, x_, P_);
   }
-}
\ No newline at end of file
+}
+
+template class UKFT<double>;
+template class UKFT<float>;
@@ -3,18 +3,64 @@
 
 #include "Eigen/Dense"
 #include "measurement_package.h"
+#include <type_traits>
+#include "models.h"
+#include "trace.h"
+#include "unscented_transform.h"
 
-class UKF {
+/**
+ * Cheap numerical health counters of a filter, refreshed on every
+ * prediction and update so long runs can be monitored for divergence.
+ */
+struct FilterHealth {
+  // number of measurement updates applied
+  long updates;
+  // Cholesky factorizations of P_aug that failed and needed a repair
+  long llt_failures;
+  // covariance repairs after an LLT failure or a non positive diagonal
+  long repairs;
+  // smallest diagonal entry of P_ after the last update
+  double min_diagonal;
+  // (max L_ii / min L_ii)^2 of the last Cholesky factor, a lower bound of cond(P_aug)
+  double condition_estimate;
+
+  FilterHealth()
+    : updates(0), llt_failures(0), repairs(0), min_diagonal(0), condition_estimate(1)
+  {}
+};
+
+/**
+ * Unscented Kalman filter over the CTRV state, templated on the scalar type.
+ * UKFT<double> is the reference filter; UKFT<float> halves the memory
+ * traffic for large track sets and defaults to the Joseph form covariance
+ * update to keep P_ symmetric positive definite in single precision.
+ */
+template <typename Scalar>
+class UKFT {
  public:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixX;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
+  typedef UnscentedTransformParams<Scalar> UnscentedTransform;
+
+  // covariance update applied after each measurement
+  enum CovarianceUpdate {
+    // P = P - K S K^T
+    STANDARD,
+    // P = (I - K H) P (I - K H)^T + K R K^T
+    JOSEPH,
+    // P = P - K S K^T, symmetrized and eigenvalues floored at min_eigenvalue_
+    SYMMETRIZE
+  };
+
   /**
    * Constructor
    */
-  UKF();
+  UKFT();
 
   /**
    * Destructor
    */
-  virtual ~UKF();
+  virtual ~UKFT();
 
   /**
    * ProcessMeasurement
@@ -41,6 +87,24 @@ class UKF {
    */
   void UpdateRadar(MeasurementPackage meas_package);
 
+  /**
+   * ProcessMeasurement for a user supplied sensor model
+   * @param model Measurement model describing the sensor
+   * @param meas_package The latest measurement data of that sensor
+   * @return NIS of the update, 0 if the measurement initialized the filter,
+   * -1 if the filter is not initialized and the model cannot initialize it
+   */
+  template <typename Sensor>
+  Scalar ProcessMeasurement(const MeasurementModel<Sensor>& model, const MeasurementPackage& meas_package);
+
+  /**
+   * Prediction with a user supplied process model
+   * @param model Process model acting on the augmented state
+   * @param delta_t Time between k and k+1 in s
+   */
+  template <typename Process>
+  void Prediction(const ProcessModel<Process>& model, double delta_t);
+
 
   // initially set to false, set to true in first call of ProcessMeasurement
   bool is_initialized_;
@@ -52,40 +116,40 @@ class UKF {
   bool use_radar_;
 
   // state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-  Eigen::VectorXd x_;
+  VectorX x_;
 
   // state covariance matrix
-  Eigen::MatrixXd P_;
+  MatrixX P_;
 
   // predicted sigma points matrix
-  Eigen::MatrixXd Xsig_pred_;
+  MatrixX Xsig_pred_;
 
   // time when the state is true, in us
   long long time_us_;
 
   // Process noise standard deviation longitudinal acceleration in m/s^2
-  double std_a_;
+  Scalar std_a_;
 
   // Process noise standard deviation yaw acceleration in rad/s^2
-  double std_yawdd_;
+  Scalar std_yawdd_;
 
   // Laser measurement noise standard deviation position1 in m
-  double std_laspx_;
+  Scalar std_laspx_;
 
   // Laser measurement noise standard deviation position2 in m
-  double std_laspy_;
+  Scalar std_laspy_;
 
   // Radar measurement noise standard deviation radius in m
-  double std_radr_;
+  Scalar std_radr_;
 
   // Radar measurement noise standard deviation angle in rad
-  double std_radphi_;
+  Scalar std_radphi_;
 
   // Radar measurement noise standard deviation radius change in m/s
-  double std_radrd_ ;
+  Scalar std_radrd_ ;
 
-  // Weights of sigma points
-  Eigen::VectorXd weights_;
+  // Sigma point weights and offsets, shared between filters
+  typename UnscentedTransform::Ptr ut_;
 
   // State dimension
   int n_x_;
@@ -93,32 +157,237 @@ class UKF {
   // Augmented state dimension
   int n_aug_;
 
-  // Sigma point spreading parameter
-  double lambda_;
+  // Sigma point spreading parameter, as set by ut_
+  Scalar lambda_;
+
+  Scalar NIS_lidar;
 
-  double NIS_lidar;
+  Scalar NIS_radar;
 
-  double NIS_radar;
+  // covariance update form, STANDARD for double and JOSEPH for float
+  CovarianceUpdate cov_update_;
 
-  void setWeight();
+  // eigenvalue floor used when P_ is symmetrized or repaired
+  Scalar min_eigenvalue_;
+
+  // numerical health counters
+  FilterHealth health_;
+
+  /**
+   * Switch to another unscented transform, e.g. a scaled or a spherical
+   * simplex one, of dimension n_aug_
+   * @param ut Shared transform parameters
+   */
+  void SetUnscentedTransform(const typename UnscentedTransform::Ptr& ut);
   //Prediction
-  void GenerateSigmaPoints(Eigen::MatrixXd* Xsig_out);
-  void AugmentSigmaPoints(Eigen::MatrixXd& Xsig_aug);
-  void PredictSigmaPoint(const Eigen::MatrixXd& Xsig_aug, const double delta_t);
+  void GenerateSigmaPoints(MatrixX* Xsig_out);
+  void AugmentSigmaPoints(MatrixX& Xsig_aug);
+  void PredictSigmaPoint(const MatrixX& Xsig_aug, const double delta_t);
   void PredictMeanAndCovariance();
   //Update
-  void PredictMeasurementLidar(Eigen::VectorXd& z_out, Eigen::MatrixXd& S_out, Eigen::MatrixXd& Zsig);
-  void UpdateStateLidar(const Eigen::MatrixXd& Zsig, 
-                        const Eigen::VectorXd& z_pred, 
-                        const Eigen::MatrixXd& S, 
-                        const Eigen::VectorXd& z);
-  void PredictMeasurementRadar(Eigen::VectorXd& z_out, Eigen::MatrixXd& S_out, Eigen::MatrixXd& Zsig);
-  void UpdateStateRadar(const Eigen::MatrixXd& Zsig, 
-                        const Eigen::VectorXd& z_pred, 
-                        const Eigen::MatrixXd& S, 
-                        const Eigen::VectorXd& z);
-
-  void norm(double& val);
+  void PredictMeasurementLidar(VectorX& z_out, MatrixX& S_out, MatrixX& Zsig);
+  void UpdateStateLidar(const MatrixX& Zsig, 
+                        const VectorX& z_pred, 
+                        const MatrixX& S, 
+                        const VectorX& z);
+  void PredictMeasurementRadar(VectorX& z_out, MatrixX& S_out, MatrixX& Zsig);
+  void UpdateStateRadar(const MatrixX& Zsig, 
+                        const VectorX& z_pred, 
+                        const MatrixX& S, 
+                        const VectorX& z);
+
+  void norm(Scalar& val);
+
+  // Covariance update and health monitoring
+  // R is the model's fixed size noise covariance, or an expression of it
+  template <typename Noise>
+  void UpdateCovariance(const MatrixX& K, const MatrixX& Tc, const MatrixX& S, const Noise& R);
+  template <typename Noise>
+  void JosephUpdate(const MatrixX& K, const MatrixX& Tc, const Noise& R);
+  void RepairCovariance(MatrixX& P);
+
+  /**
+   * Update the state with a measurement of the given model; linear models
+   * take the closed form Kalman filter path, all others the unscented one
+   * @param model Measurement model of the sensor
+   * @param z Incoming measurement
+   * @return NIS of the update
+   */
+  template <typename Sensor>
+  Scalar Update(const MeasurementModel<Sensor>& model, const VectorX& z);
+
+  // Model generic building blocks, resolved at compile time
+  template <typename Process>
+  void PredictSigmaPoints(const ProcessModel<Process>& model, const MatrixX& Xsig_aug, const double delta_t);
+  template <typename Sensor>
+  void PredictMeasurement(const MeasurementModel<Sensor>& model, VectorX& z_out, MatrixX& S_out, MatrixX& Zsig);
+  template <typename Sensor>
+  Scalar UpdateState(const MeasurementModel<Sensor>& model,
+                     const MatrixX& Zsig,
+                     const VectorX& z_pred,
+                     const MatrixX& S,
+                     const VectorX& z);
+  template <typename Sensor>
+  Scalar Update(const MeasurementModel<Sensor>& model, const VectorX& z, std::true_type linear);
+  template <typename Sensor>
+  Scalar Update(const MeasurementModel<Sensor>& model, const VectorX& z, std::false_type linear);
 };
 
+template <typename Scalar>
+template <typename Sensor>
+Scalar UKFT<Scalar>::ProcessMeasurement(const MeasurementModel<Sensor>& model, const MeasurementPackage& meas_package) {
+  double dt = (meas_package.timestamp_ - time_us_) / 1.0e6;
+  time_us_ = meas_package.timestamp_;
+  Prediction(dt);
+  if(!is_initialized_){
+    is_initialized_ = model.Initialize(meas_package.raw_measurements_, x_, P_);
+    return is_initialized_ ? 0 : -1;
+  }
+  return Update(model, meas_package.raw_measurements_.cast<Scalar>());
+}
+
+template <typename Scalar>
+template <typename Sensor>
+Scalar UKFT<Scalar>::Update(const MeasurementModel<Sensor>& model, const VectorX& z) {
+  return Update(model, z, std::integral_constant<bool, Sensor::kLinear != 0>());
+}
+
+template <typename Scalar>
+template <typename Sensor>
+Scalar UKFT<Scalar>::Update(const MeasurementModel<Sensor>& model, const VectorX& z, std::false_type) {
+  VectorX z_pred;
+  MatrixX S;
+  MatrixX ZSig;
+  PredictMeasurement(model, z_pred, S, ZSig);
+  return UpdateState(model, ZSig, z_pred, S, z);
+}
+
+// For z = H x + noise the unscented transform of the predicted sigma points
+// reproduces H x_, H P_ H^T and P_ H^T exactly, so they are formed directly
+template <typename Scalar>
+template <typename Sensor>
+Scalar UKFT<Scalar>::Update(const MeasurementModel<Sensor>& model, const VectorX& z, std::true_type) {
+  TRACE_SCOPE("UKF::LinearUpdate");
+  const Sensor& sensor = static_cast<const Sensor&>(model);
+  MatrixX H = sensor.ObservationMatrix(n_x_).template cast<Scalar>();
+  MatrixX PHt = P_ * H.transpose();
+  MatrixX S = H * PHt;
+  S += model.NoiseCovariance().template cast<Scalar>();
+  MatrixX S_Inverse = S.inverse();
+  MatrixX K = PHt * S_Inverse;
+  VectorX z_diff = z - H * x_;
+  model.Normalize(z_diff);
+  x_ = x_ + K * z_diff;
+  UpdateCovariance(K, PHt, S, model.NoiseCovariance().template cast<Scalar>());
+  return z_diff.transpose() * S_Inverse * z_diff;
+}
+
+template <typename Scalar>
+template <typename Process>
+void UKFT<Scalar>::Prediction(const ProcessModel<Process>& model, double delta_t) {
+  TRACE_SCOPE("UKF::Prediction");
+  if(is_initialized_){
+    MatrixX Xsig_aug;
+    AugmentSigmaPoints(Xsig_aug);
+    PredictSigmaPoints(model, Xsig_aug, delta_t);
+    PredictMeanAndCovariance();
+  }
+}
+
+template <typename Scalar>
+template <typename Process>
+void UKFT<Scalar>::PredictSigmaPoints(const ProcessModel<Process>& model, const MatrixX& Xsig_aug, const double delta_t) {
+  TRACE_SCOPE("UKF::PredictSigmaPoints");
+  model.PredictAll(Xsig_aug, delta_t, Xsig_pred_);
+}
+
+template <typename Scalar>
+template <typename Sensor>
+void UKFT<Scalar>::PredictMeasurement(const MeasurementModel<Sensor>& model, VectorX& z_out, MatrixX& S_out, MatrixX& Zsig) {
+  TRACE_SCOPE("UKF::PredictMeasurement");
+  int n_z = Sensor::kSize;
+  Zsig = MatrixX(n_z, ut_->n_sig_);
+  for (int i = 0; i < ut_->n_sig_; ++i) {
+    model.Measure(Xsig_pred_.col(i), Zsig.col(i));
+  }
+  VectorX z_pred = Zsig * ut_->weights_m_;
+  MatrixX Zdiff = Zsig.colwise() - z_pred;
+  model.Normalize(Zdiff);
+  MatrixX S = Zdiff * ut_->weights_c_.asDiagonal() * Zdiff.transpose();
+  S += model.NoiseCovariance().template cast<Scalar>();
+  z_out = z_pred;
+  S_out = S;
+}
+
+template <typename Scalar>
+template <typename Sensor>
+Scalar UKFT<Scalar>::UpdateState(const MeasurementModel<Sensor>& model,
+                        const MatrixX& Zsig,      //sigma points in measurement space
+                        const VectorX& z_pred,    //predicted measurement mean
+                        const MatrixX& S,         //predicted measurement covariance
+                        const VectorX& z          //incoming measurement
+                        ) {
+  TRACE_SCOPE("UKF::UpdateState");
+  MatrixX Zdiff = Zsig.colwise() - z_pred;
+  model.Normalize(Zdiff);
+  MatrixX Xdiff = Xsig_pred_.colwise() - x_;
+  NormalizeAngles(Xdiff.row(3));
+  MatrixX Tc = Xdiff * ut_->weights_c_.asDiagonal() * Zdiff.transpose();
+  MatrixX S_Inverse = S.inverse();
+  MatrixX K = Tc * S_Inverse;
+  VectorX z_diff = z - z_pred;
+  model.Normalize(z_diff);
+  x_ = x_ + K * z_diff;
+  UpdateCovariance(K, Tc, S, model.NoiseCovariance().template cast<Scalar>());
+  return z_diff.transpose() * S_Inverse * z_diff;
+}
+
+template <typename Scalar>
+template <typename Noise>
+void UKFT<Scalar>::UpdateCovariance(const MatrixX& K, const MatrixX& Tc, const MatrixX& S, const Noise& R) {
+  switch (cov_update_) {
+    case JOSEPH:
+      JosephUpdate(K, Tc, R);
+      break;
+    case SYMMETRIZE:
+      P_ = P_ - K*S*K.transpose();
+      RepairCovariance(P_);
+      break;
+    default:
+      P_ = P_ - K*S*K.transpose();
+      break;
+  }
+  health_.updates++;
+  health_.min_diagonal = P_.diagonal().minCoeff();
+  if (health_.min_diagonal <= 0) {
+    health_.repairs++;
+    RepairCovariance(P_);
+    health_.min_diagonal = P_.diagonal().minCoeff();
+  }
+}
+
+/**
+ * Joseph form covariance update
+ *   P = (I - K H) P (I - K H)^T + K R K^T
+ * The UKF has no explicit H, so the statistically linearized one,
+ * H = Tc^T P^-1, is used. Every term is a symmetric product, which keeps
+ * P_ positive definite where the short form P - K S K^T loses it to
+ * rounding in single precision.
+ */
+template <typename Scalar>
+template <typename Noise>
+void UKFT<Scalar>::JosephUpdate(const MatrixX& K, const MatrixX& Tc, const Noise& R) {
+  MatrixX H = P_.ldlt().solve(Tc).transpose();
+  MatrixX I_KH = MatrixX::Identity(n_x_, n_x_) - K * H;
+  P_ = I_KH * P_ * I_KH.transpose() + K * R * K.transpose();
+  P_ = 0.5 * (P_ + P_.transpose());
+}
+
+// the filter used for tracking, single precision when built with UKF_USE_FLOAT
+#ifdef UKF_USE_FLOAT
+typedef UKFT<float> UKF;
+#else
+typedef UKFT<double> UKF;
+#endif
+
 #endif  // UKF_H
\ No newline at end of file
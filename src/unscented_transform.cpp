@@ -0,0 +1,93 @@
+#include "unscented_transform.h"
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+template <typename Scalar>
+UnscentedTransformParams<Scalar>::UnscentedTransformParams(int n, SigmaPointSet set)
+  : n_(n), n_sig_(set == SYMMETRIC ? 2*n+1 : n+2), set_(set), lambda_(0) {
+  weights_m_ = VectorX::Zero(n_sig_);
+  unit_sigma_ = MatrixX::Zero(n_, n_sig_);
+}
+
+template <typename Scalar>
+typename UnscentedTransformParams<Scalar>::Ptr
+UnscentedTransformParams<Scalar>::Symmetric(int n, double alpha, double beta, double kappa) {
+  // sqrt(n + kappa) spreads the points, the weights divide by n + kappa and alpha^2
+  if (!(n + kappa > 0)) {
+    throw std::invalid_argument("UnscentedTransformParams::Symmetric needs n + kappa > 0");
+  }
+  if (!(alpha > 0)) {
+    throw std::invalid_argument("UnscentedTransformParams::Symmetric needs alpha > 0");
+  }
+  UnscentedTransformParams* ut = new UnscentedTransformParams(n, SYMMETRIC);
+  double spread = std::sqrt(n + kappa);
+  ut->weights_m_(0) = kappa/(n + kappa);
+  for (int i = 0; i < n; ++i) {
+    ut->weights_m_(i+1) = 0.5/(n + kappa);
+    ut->weights_m_(i+1+n) = 0.5/(n + kappa);
+    ut->unit_sigma_(i, i+1) = spread;
+    ut->unit_sigma_(i, i+1+n) = -spread;
+  }
+  ut->lambda_ = alpha*alpha*(n + kappa) - n;
+  ut->Scale(alpha, beta);
+  return Ptr(ut);
+}
+
+/**
+ * Julier's spherical simplex: with W1 = (1-w0)/(n+1) the points are built
+ * dimension by dimension,
+ *   j = 1: [0], [-1/sqrt(2 W1)], [1/sqrt(2 W1)]
+ *   j > 1: existing points get -1/sqrt(j(j+1) W1) appended, the center
+ *          gets 0 and a new point [0 ... 0, j/sqrt(j(j+1) W1)] is added.
+ */
+template <typename Scalar>
+typename UnscentedTransformParams<Scalar>::Ptr
+UnscentedTransformParams<Scalar>::SphericalSimplex(int n, double w0, double alpha, double beta) {
+  UnscentedTransformParams* ut = new UnscentedTransformParams(n, SPHERICAL_SIMPLEX);
+  double w1 = (1 - w0)/(n + 1);
+  ut->weights_m_(0) = w0;
+  for (int i = 1; i < n + 2; ++i) {
+    ut->weights_m_(i) = w1;
+  }
+  ut->unit_sigma_(0, 1) = -1/std::sqrt(2*w1);
+  ut->unit_sigma_(0, 2) = 1/std::sqrt(2*w1);
+  for (int j = 2; j <= n; ++j) {
+    double s = 1/std::sqrt(j*(j + 1)*w1);
+    for (int i = 1; i <= j; ++i) {
+      ut->unit_sigma_(j-1, i) = -s;
+    }
+    ut->unit_sigma_(j-1, j+1) = j*s;
+  }
+  ut->Scale(alpha, beta);
+  return Ptr(ut);
+}
+
+template <typename Scalar>
+typename UnscentedTransformParams<Scalar>::Ptr
+UnscentedTransformParams<Scalar>::Default(int n) {
+  static std::mutex lock;
+  static std::map<int, Ptr> shared;
+  std::lock_guard<std::mutex> guard(lock);
+  Ptr& ut = shared[n];
+  if (!ut) {
+    ut = Symmetric(n, 1.0, 0.0, 3.0 - n);
+  }
+  return ut;
+}
+
+// scaled unscented transform: spread the points by alpha around the center
+// and compensate the weights, beta adds the higher order covariance term
+template <typename Scalar>
+void UnscentedTransformParams<Scalar>::Scale(double alpha, double beta) {
+  double a2 = alpha*alpha;
+  unit_sigma_ *= Scalar(alpha);
+  weights_m_(0) = weights_m_(0)/a2 + (1 - 1/a2);
+  weights_m_.tail(n_sig_-1) /= Scalar(a2);
+  weights_c_ = weights_m_;
+  weights_c_(0) += 1 - a2 + beta;
+}
+
+template class UnscentedTransformParams<double>;
+template class UnscentedTransformParams<float>;
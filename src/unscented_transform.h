@@ -0,0 +1,83 @@
+#ifndef UNSCENTED_TRANSFORM_H
+#define UNSCENTED_TRANSFORM_H
+
+#include "Eigen/Dense"
+#include <memory>
+
+/**
+ * Precomputed parameters of an unscented transform of dimension n.
+ *
+ * Sigma points are generated as
+ *   X = x * 1^T + L * unit_sigma_
+ * where L is the Cholesky factor of the covariance, so the spreading
+ * factor sqrt(lambda + n) is folded into unit_sigma_ once and never
+ * recomputed. Parameters are immutable after construction and meant to be
+ * shared between all filters of the same dimension.
+ */
+template <typename Scalar>
+class UnscentedTransformParams {
+ public:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixX;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
+  typedef std::shared_ptr<const UnscentedTransformParams> Ptr;
+
+  enum SigmaPointSet {
+    // 2n+1 points placed symmetrically along the Cholesky columns
+    SYMMETRIC,
+    // n+2 points on a hypersphere, Julier's spherical simplex set
+    SPHERICAL_SIMPLEX
+  };
+
+  /**
+   * Scaled unscented transform, lambda = alpha^2 (n + kappa) - n
+   * @param n State dimension
+   * @param alpha Spread of the sigma points around the mean
+   * @param beta Prior knowledge of the distribution, 2 is optimal for Gaussians
+   * @param kappa Secondary scaling parameter
+   * @throws std::invalid_argument if n + kappa <= 0, which leaves no real
+   * spread, or alpha <= 0
+   */
+  static Ptr Symmetric(int n, double alpha, double beta, double kappa);
+
+  /**
+   * Scaled spherical simplex transform with n+2 sigma points
+   * @param n State dimension
+   * @param w0 Weight of the center point in [0, 1)
+   * @param alpha Spread of the sigma points around the mean
+   * @param beta Prior knowledge of the distribution, 2 is optimal for Gaussians
+   */
+  static Ptr SphericalSimplex(int n, double w0, double alpha, double beta);
+
+  /**
+   * Shared default used by the UKF, the symmetric set with lambda = 3 - n
+   * @param n State dimension
+   */
+  static Ptr Default(int n);
+
+  // dimension of the transformed state
+  int n_;
+
+  // number of sigma points
+  int n_sig_;
+
+  SigmaPointSet set_;
+
+  // spreading parameter of the symmetric set
+  double lambda_;
+
+  // weights for the mean
+  VectorX weights_m_;
+
+  // weights for the covariance
+  VectorX weights_c_;
+
+  // sigma point offsets for an identity covariance, n x n_sig
+  MatrixX unit_sigma_;
+
+ private:
+  UnscentedTransformParams(int n, SigmaPointSet set);
+
+  void Scale(double alpha, double beta);
+};
+
+#endif  // UNSCENTED_TRANSFORM_H
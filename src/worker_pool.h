@@ -0,0 +1,98 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads that stay parked between jobs, so work that is split over
+ * threads every frame does not start and join them every frame. run()
+ * hands the same job to every worker and to the calling thread, and
+ * returns once all of them are done with it; the job divides the work
+ * itself, e.g. through an atomic counter. Jobs run one at a time, a
+ * second caller waits for the first job to finish.
+ */
+class WorkerPool
+{
+public:
+	// numThreads threads take part in every job, the calling thread included
+	explicit WorkerPool(int numThreads)
+		: job(nullptr), generation(0), pending(0), stopping(false)
+	{
+		for(int t = 1; t < numThreads; t++)
+			workers.push_back(std::thread(&WorkerPool::loop, this));
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		start.notify_all();
+		for(std::thread& worker : workers)
+			worker.join();
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	int threads() const { return (int)workers.size() + 1; }
+
+	void run(const std::function<void()>& work)
+	{
+		std::lock_guard<std::mutex> turn(running);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &work;
+			generation++;
+			pending = (int)workers.size();
+		}
+		start.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this]() { return pending == 0; });
+		job = nullptr;
+	}
+
+private:
+	void loop()
+	{
+		long long seen = 0;
+		for(;;)
+		{
+			const std::function<void()>* work;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start.wait(lock, [&]() { return stopping || generation > seen; });
+				if(stopping)
+					return;
+				seen = generation;
+				work = job;
+			}
+			(*work)();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(--pending == 0)
+					finished.notify_one();
+			}
+		}
+	}
+
+	// held for a whole job
+	std::mutex running;
+	// guards everything below, generation counts started jobs
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable finished;
+	const std::function<void()>* job;
+	long long generation;
+	int pending;
+	bool stopping;
+	std::vector<std::thread> workers;
+};
+
+#endif /* WORKER_POOL_H_ */